@@ -0,0 +1,79 @@
+#ifndef __CHASES_H__
+#define __CHASES_H__
+
+/**
+ * Chases.  A chase is a list of scenes that the converter runs through on its
+ * own, one step after another, so the timing doesn't depend on Proclaim (or
+ * the USB bus) keeping up.  Each step fades to a scene, then holds it for a
+ * while before the next step starts.  After the last step, the chase starts
+ * over from the first.
+ * 
+ * To start a chase from Proclaim, send a "Polyphonic Aftertouch" (Key
+ * Pressure) command.  The "Note" selects the chase, and the "Pressure" sets the
+ * speed: 64 runs the chase at the times below, 32 is half speed, 127 is almost
+ * twice as fast, and so on.  A pressure of 0 stops the chase.  Sending the
+ * command for the chase that is already running just changes the speed, from
+ * the next step on.  The MIDI channel picks the fade curve, the same as for
+ * scenes.
+ * 
+ * Only one chase runs at a time.  Starting another chase, or sending a scene
+ * command, stops the one that is running (the lights stay where they are).
+ * Fixture and raw DMX channel commands leave it running.
+ * 
+ * To add a chase, add a list of steps in the same style as the examples, then
+ * add it to the end of the chases list.  The fade and hold times are in tenths
+ * of a second, so {17, 30, 100} fades to scene 17 over 3 seconds, then holds it
+ * for 10 seconds.  The build checks that every step is a valid scene.
+ */
+
+typedef struct {
+  byte scene;
+  uint16_t fade_tenths;
+  uint16_t hold_tenths;
+} chase_step;
+
+typedef struct {
+  const chase_step *steps;
+  byte step_count;
+} chase_data;
+
+#define CHASE(steps) {steps, sizeof(steps) / sizeof(chase_step)}
+
+// Preservice: slowly run through the preservice colors.
+constexpr PROGMEM chase_step chase_preservice[] = {
+  {1, 50, 250},
+  {2, 50, 250},
+  {3, 50, 250},
+  {4, 50, 250},
+  {5, 50, 250},
+  {6, 50, 250},
+  {7, 50, 250},
+  {8, 50, 250},
+};
+
+// Good Friday: fade up through the Good Friday scenes, then back down.
+constexpr PROGMEM chase_step chase_good_friday[] = {
+  {100, 20, 0},
+  {102, 20, 0},
+  {104, 20, 0},
+  {106, 20, 0},
+  {108, 20, 0},
+  {110, 20, 50},
+  {108, 20, 0},
+  {106, 20, 0},
+  {104, 20, 0},
+  {102, 20, 50},
+};
+
+/**
+ * The list of chases.  The position in the list is the "Note" used to start
+ * the chase.
+ */
+constexpr PROGMEM chase_data chases[] = {
+  CHASE(chase_preservice),   // 0: Preservice
+  CHASE(chase_good_friday),  // 1: Good Friday
+};
+
+#define CHASE_COUNT (sizeof(chases) / sizeof(chase_data))
+
+#endif // __CHASES_H__
@@ -50,15 +50,45 @@
 #define MIDI_COMMAND_MASK 0x70
 #define MIDI_NOTE_OFF 0x00
 #define MIDI_NOTE_ON 0x10
+#define MIDI_POLY_PRESSURE 0x20
 #define MIDI_CONTROL_CHANGE 0x30
+#define MIDI_PROGRAM_CHANGE 0x40
+#define MIDI_CHANNEL_PRESSURE 0x50
+
+// The MIDI clock tick, a single byte real time message.
+#define MIDI_TIMING_CLOCK 0xf8
 
 // Set these in the valid bit - need to be non-zero.
 #define COMMAND_SCENE 0x1
 #define COMMAND_FIXTURE 0x2
 #define COMMAND_CHANNEL 0x3
+#define COMMAND_COMMIT 0x4
+#define COMMAND_CHASE 0x5
+#define COMMAND_RELEASE 0x6
 
 #define MS_PER_SECOND 1000
 
+/**
+ * System exclusive messages.  These use the non-commercial manufacturer ID, and
+ * the byte after it is the request.
+ */
+#define SYSEX_START 0xf0
+#define SYSEX_END 0xf7
+#define SYSEX_ID_NON_COMMERCIAL 0x7d
+#define SYSEX_READ_COUNTERS 0x01
+#define SYSEX_RESET_COUNTERS 0x02
+#define SYSEX_READ_CAPTURE 0x03
+#define SYSEX_START_TELEMETRY 0x04
+#define SYSEX_STOP_TELEMETRY 0x05
+#define SYSEX_TELEMETRY 0x06
+
+// USB MIDI code index numbers for the SysEx packets: start or continue (3
+// bytes), and end with 1, 2, or 3 bytes.
+#define USB_MIDI_SYSEX_START 0x4
+#define USB_MIDI_SYSEX_END_1 0x5
+#define USB_MIDI_SYSEX_END_2 0x6
+#define USB_MIDI_SYSEX_END_3 0x7
+
 /*
  * Dim a given value to a given percent (0-100).
  * 
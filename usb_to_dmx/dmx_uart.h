@@ -0,0 +1,135 @@
+#ifndef __DMX_UART_H__
+#define __DMX_UART_H__
+
+/**
+ * DMX output from the hardware UART (USART1 on the 32U4, which comes out on the
+ * TX pin of the Pro Micro - wire that to the RS-485 driver instead of pin 3).
+ * 
+ * DmxMaster bit-bangs each slot from a timer interrupt with interrupts off,
+ * which takes a good chunk of the CPU away from the fader and the MIDI input.
+ * The UART shifts the bits out by itself, so this only needs a short interrupt
+ * once per slot (every 44us) to load the next byte, and two more per frame to
+ * make the break.
+ * 
+ * The break and mark after break are made by sending a single 0 at 100kbaud:
+ * the start bit and 8 data bits hold the line low for 90us (the break), and
+ * the stop bit holds it high for 10us (the mark after break).  Then the baud
+ * rate goes back to 250kbaud, 8N2, for the start code and the slots.
+ * 
+ * The AVR has no DMA, so this is as little CPU as it gets on this chip.
+ */
+
+#include <util/atomic.h>
+
+#if !defined(UDR1)
+#error "DMX_OUTPUT_UART needs USART1 (the 32U4 based units)"
+#endif
+
+// The whole universe fits, as there's no bit-banging buffer limit here.
+#define DMX_SIZE 512
+
+#define DMX_UART_BAUD 250000
+#define DMX_UART_BREAK_BAUD 100000
+#define DMX_UART_UBRR ((F_CPU / 16 / DMX_UART_BAUD) - 1)
+#define DMX_UART_BREAK_UBRR ((F_CPU / 16 / DMX_UART_BREAK_BAUD) - 1)
+
+// 8 data bits, and either 1 stop bit (the break) or 2 (the slots).
+#define DMX_UART_BREAK_FORMAT (_BV(UCSZ11) | _BV(UCSZ10))
+#define DMX_UART_SLOT_FORMAT (_BV(UCSZ11) | _BV(UCSZ10) | _BV(USBS1))
+
+/**
+ * The channel values, the same as DmxMaster's buffer, so the rest of the code
+ * doesn't care which one is sending them out.
+ */
+volatile uint8_t dmxBuffer[DMX_SIZE];
+
+// Number of channel slots in each frame, and in the frame going out.  The
+// frame's own count is taken as its slots start, so a change halfway through
+// only takes effect from the next frame.
+uint16_t dmx_uart_channels;
+uint16_t dmx_uart_frame_channels;
+
+// The next slot to load into the UART.  0 is the start code, and the channels
+// follow from 1.
+uint16_t dmx_uart_next_slot;
+
+// True while the break byte is going out.
+bool dmx_uart_in_break;
+
+// Counts up as each frame finishes, so the fader can run once per frame.
+volatile uint8_t dmx_uart_frame_count;
+
+/**
+ * Send the break byte.  The transmit complete interrupt fires once it (and the
+ * last slot of the previous frame before it) is all the way out.
+ */
+inline void send_dmx_uart_break() {
+  UCSR1B = _BV(TXEN1);
+  UBRR1 = DMX_UART_BREAK_UBRR;
+  UCSR1C = DMX_UART_BREAK_FORMAT;
+  dmx_uart_in_break = true;
+  UCSR1A = _BV(TXC1);
+  UDR1 = 0;
+  UCSR1B = _BV(TXEN1) | _BV(TXCIE1);
+}
+
+/**
+ * The UART has room for the next slot.  After the last one is loaded, wait for
+ * it to finish before changing the baud rate for the break.
+ */
+ISR(USART1_UDRE_vect) {
+  if (dmx_uart_next_slot == 0) {
+    UDR1 = 0;
+  } else {
+    UDR1 = dmxBuffer[dmx_uart_next_slot - 1];
+  }
+  
+  if (dmx_uart_next_slot++ >= dmx_uart_frame_channels) {
+    UCSR1A = _BV(TXC1);
+    UCSR1B = _BV(TXEN1) | _BV(TXCIE1);
+  }
+}
+
+/**
+ * Everything loaded has gone out.  Either the frame is done, so count it and
+ * start the break, or the break is done, so start the slots.
+ */
+ISR(USART1_TX_vect) {
+  if (!dmx_uart_in_break) {
+    dmx_uart_frame_count++;
+    send_dmx_uart_break();
+    return;
+  }
+  
+  UBRR1 = DMX_UART_UBRR;
+  UCSR1C = DMX_UART_SLOT_FORMAT;
+  dmx_uart_in_break = false;
+  dmx_uart_next_slot = 0;
+  dmx_uart_frame_channels = dmx_uart_channels;
+  UCSR1B = _BV(TXEN1) | _BV(UDRIE1);
+}
+
+/**
+ * Start sending frames.  They carry on forever from the interrupts.
+ * 
+ * @param channels The number of channel slots in each frame.
+ */
+inline void start_dmx_uart(const uint16_t channels) {
+  dmx_uart_channels = channels;
+  send_dmx_uart_break();
+}
+
+/**
+ * Change the number of channel slots in each frame, from the next one.  The
+ * interrupt reads this, and it's two bytes, so it can't change halfway through
+ * a read.
+ * 
+ * @param channels The number of channel slots in each frame.
+ */
+inline void set_dmx_uart_channels(const uint16_t channels) {
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    dmx_uart_channels = channels;
+  }
+}
+
+#endif // __DMX_UART_H__
@@ -0,0 +1,87 @@
+#ifndef __FADE_CURVES_H__
+#define __FADE_CURVES_H__
+
+/**
+ * Fade curves.  A plain linear fade looks abrupt at the low end on most lights
+ * (especially the LED cans) and seems to drag at the top, as the eye doesn't
+ * see brightness linearly.  These tables reshape the position through a fade,
+ * so the fader can run a curved fade with a table read instead of any math.
+ * 
+ * Each table maps the top byte of the fade position (0-255) to a new position,
+ * out of 256.  The fader smooths between neighbouring entries, so long fades
+ * don't step.  Every table must only ever go up.
+ * 
+ * To pick a curve from Proclaim, send the scene command (or the CC 0 that
+ * starts a raw DMX channel fade) on the MIDI channel for the curve: channel 1
+ * is linear, 2 is square law, 3 is inverse square law, and 4 is the S-curve.
+ * Channels past these are linear.
+ */
+
+#define FADE_CURVE_LINEAR 0
+#define FADE_CURVE_SQUARE 1
+#define FADE_CURVE_INVERSE_SQUARE 2
+#define FADE_CURVE_S 3
+#define FADE_CURVE_COUNT 4
+
+// Linear fades don't need a table, so the first table is for curve 1.
+const PROGMEM uint8_t fade_curves[FADE_CURVE_COUNT - 1][256] = {
+  // Square law: starts slowly, and speeds up towards the end.
+  {
+      0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  1,  1,  1,  1,
+      1,  1,  1,  1,  2,  2,  2,  2,  2,  2,  3,  3,  3,  3,  4,  4,
+      4,  4,  5,  5,  5,  5,  6,  6,  6,  7,  7,  7,  8,  8,  8,  9,
+      9,  9, 10, 10, 11, 11, 11, 12, 12, 13, 13, 14, 14, 15, 15, 16,
+     16, 17, 17, 18, 18, 19, 19, 20, 20, 21, 21, 22, 23, 23, 24, 24,
+     25, 26, 26, 27, 28, 28, 29, 30, 30, 31, 32, 32, 33, 34, 35, 35,
+     36, 37, 38, 38, 39, 40, 41, 41, 42, 43, 44, 45, 46, 46, 47, 48,
+     49, 50, 51, 52, 53, 53, 54, 55, 56, 57, 58, 59, 60, 61, 62, 63,
+     64, 65, 66, 67, 68, 69, 70, 71, 72, 73, 74, 75, 77, 78, 79, 80,
+     81, 82, 83, 84, 86, 87, 88, 89, 90, 91, 93, 94, 95, 96, 98, 99,
+    100,101,103,104,105,106,108,109,110,112,113,114,116,117,118,120,
+    121,122,124,125,127,128,129,131,132,134,135,137,138,140,141,143,
+    144,146,147,149,150,152,153,155,156,158,159,161,163,164,166,167,
+    169,171,172,174,176,177,179,181,182,184,186,187,189,191,193,194,
+    196,198,200,201,203,205,207,208,210,212,214,216,218,219,221,223,
+    225,227,229,231,233,234,236,238,240,242,244,246,248,250,252,254,
+  },
+  // Inverse square law: starts quickly, and slows down towards the end.
+  {
+      0,  2,  4,  6,  8, 10, 12, 14, 16, 18, 20, 22, 23, 25, 27, 29,
+     31, 33, 35, 37, 38, 40, 42, 44, 46, 48, 49, 51, 53, 55, 56, 58,
+     60, 62, 63, 65, 67, 69, 70, 72, 74, 75, 77, 79, 80, 82, 84, 85,
+     87, 89, 90, 92, 93, 95, 97, 98,100,101,103,104,106,107,109,110,
+    112,113,115,116,118,119,121,122,124,125,127,128,129,131,132,134,
+    135,136,138,139,140,142,143,144,146,147,148,150,151,152,153,155,
+    156,157,158,160,161,162,163,165,166,167,168,169,170,172,173,174,
+    175,176,177,178,179,181,182,183,184,185,186,187,188,189,190,191,
+    192,193,194,195,196,197,198,199,200,201,202,203,203,204,205,206,
+    207,208,209,210,210,211,212,213,214,215,215,216,217,218,218,219,
+    220,221,221,222,223,224,224,225,226,226,227,228,228,229,230,230,
+    231,232,232,233,233,234,235,235,236,236,237,237,238,238,239,239,
+    240,240,241,241,242,242,243,243,244,244,245,245,245,246,246,247,
+    247,247,248,248,248,249,249,249,250,250,250,251,251,251,251,252,
+    252,252,252,253,253,253,253,254,254,254,254,254,254,255,255,255,
+    255,255,255,255,255,255,255,255,255,255,255,255,255,255,255,255,
+  },
+  // S-curve: starts and ends slowly, quickest in the middle.
+  {
+      0,  0,  0,  0,  0,  0,  0,  1,  1,  1,  1,  1,  2,  2,  2,  3,
+      3,  3,  4,  4,  4,  5,  5,  6,  6,  7,  7,  8,  9,  9, 10, 10,
+     11, 12, 12, 13, 14, 14, 15, 16, 17, 18, 18, 19, 20, 21, 22, 23,
+     24, 25, 25, 26, 27, 28, 29, 30, 31, 32, 33, 35, 36, 37, 38, 39,
+     40, 41, 42, 43, 45, 46, 47, 48, 49, 51, 52, 53, 54, 56, 57, 58,
+     59, 61, 62, 63, 65, 66, 67, 69, 70, 71, 73, 74, 75, 77, 78, 80,
+     81, 82, 84, 85, 87, 88, 90, 91, 92, 94, 95, 97, 98,100,101,103,
+    104,106,107,109,110,112,113,115,116,118,119,121,122,124,125,127,
+    128,129,131,132,134,135,137,138,140,141,143,144,146,147,149,150,
+    152,153,155,156,158,159,161,162,164,165,166,168,169,171,172,174,
+    175,176,178,179,181,182,183,185,186,187,189,190,191,193,194,195,
+    197,198,199,200,202,203,204,205,207,208,209,210,211,213,214,215,
+    216,217,218,219,220,221,223,224,225,226,227,228,229,230,231,231,
+    232,233,234,235,236,237,238,238,239,240,241,242,242,243,244,244,
+    245,246,246,247,247,248,249,249,250,250,251,251,252,252,252,253,
+    253,253,254,254,254,255,255,255,255,255,255,255,255,255,255,255,
+  },
+};
+
+#endif // __FADE_CURVES_H__
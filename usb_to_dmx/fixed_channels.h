@@ -9,7 +9,7 @@
  */
 
 typedef struct {
-  byte channel; // DMX channel (1-127)
+  uint16_t channel; // DMX channel (1-512)
   byte value; // Value (0-255))
 } fixed_channel;
 
@@ -18,7 +18,7 @@ typedef struct {
  * existing line, append it to the end, and change the values.  The first value
  * is the DMX channel, and the second value is the value for that channel.
  */
-const PROGMEM fixed_channel fixed_channels[] = {
+constexpr PROGMEM fixed_channel fixed_channels[] = {
   //{32, 255}, // Channel 32 - RGB LED mode // TEST TEST TEST
   //{33, 255}, // Channel 33 - RGB brightness // TEST TEST TEST
   {64, 255}, // Channel 64 - RGB LED mode
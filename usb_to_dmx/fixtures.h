@@ -9,12 +9,70 @@
  * To send fixture commands from Proclaim, create a new lighting command with
  * the "Note Off" type.  The "Channel" selects the fixture, the "Note" selects
  * either the light color index or sets the brightness for a single channel
- * fixture, and the "Velocity" sets the fade time (in seconds).
+ * fixture, and the "Velocity" sets the fade time (in seconds, or as set out in
+ * get_fade_millis() for fast fade times).
  */
 
 #define FIXTURE_UNUSED 0x00
 #define FIXTURE_RGB 0x10
 #define FIXTURE_WHITE 0x20
+#define FIXTURE_RGBW 0x30
+#define FIXTURE_RGBA 0x40
+#define FIXTURE_RGBWA 0x50
+#define FIXTURE_WHITE_16 0x60
+#define FIXTURE_DIMMER_16_RGBW 0x70
+#define FIXTURE_TYPE_COUNT 8
+
+// The fixture types go up in 0x10 steps, so this is the type's profile.
+#define FIXTURE_TYPE_INDEX(type) ((type) >> 4)
+
+/**
+ * What each channel of a fixture does.  The dimmer is the brightness of the
+ * whole fixture (or the only channel of a white fixture).  A 16-bit dimmer has
+ * its coarse (top 8 bits) channel first, and the fine (bottom 8 bits) channel
+ * straight after it, and fades through all 65536 steps so it doesn't visibly
+ * step at low levels.
+ */
+#define EMITTER_RED 0
+#define EMITTER_GREEN 1
+#define EMITTER_BLUE 2
+#define EMITTER_WHITE 3
+#define EMITTER_AMBER 4
+#define EMITTER_DIMMER 5
+#define EMITTER_DIMMER_FINE 6
+#define EMITTER_COUNT 7
+
+// The most DMX channels a fixture type can have.
+#define MAX_FIXTURE_CHANNELS 6
+
+typedef struct {
+  uint8_t channel_count;
+  uint8_t layout[MAX_FIXTURE_CHANNELS];
+} fixture_profile;
+
+/**
+ * The fixture types, in the order of the type values above: how many channels
+ * each has, and what each of them does, from the base address up.  To support
+ * a new kind of fixture, add a type above and its profile at the bottom here.
+ * 
+ * Fixtures with a red channel are set to one of the colors below.  The white
+ * and amber channels are worked out from the color: the white takes the part of
+ * the color that all of red, green and blue share, and the amber takes the red
+ * and half as much green that's left.  Fixtures without a red channel are set
+ * to a brightness, like the white fixtures always have been.
+ */
+constexpr PROGMEM fixture_profile fixture_profiles[FIXTURE_TYPE_COUNT] = {
+  {0, {}}, // FIXTURE_UNUSED
+  {3, {EMITTER_RED, EMITTER_GREEN, EMITTER_BLUE}}, // FIXTURE_RGB
+  {1, {EMITTER_DIMMER}}, // FIXTURE_WHITE
+  {4, {EMITTER_RED, EMITTER_GREEN, EMITTER_BLUE, EMITTER_WHITE}}, // RGBW
+  {4, {EMITTER_RED, EMITTER_GREEN, EMITTER_BLUE, EMITTER_AMBER}}, // RGBA
+  {5, {EMITTER_RED, EMITTER_GREEN, EMITTER_BLUE, EMITTER_WHITE, // RGBWA
+          EMITTER_AMBER}},
+  {2, {EMITTER_DIMMER, EMITTER_DIMMER_FINE}}, // FIXTURE_WHITE_16
+  {6, {EMITTER_DIMMER, EMITTER_DIMMER_FINE, EMITTER_RED, EMITTER_GREEN,
+          EMITTER_BLUE, EMITTER_WHITE}}, // FIXTURE_DIMMER_16_RGBW (movers)
+};
 
 // As MIDI channels are used to select fixtures, only 16 fixtures are allowed.
 #define MAX_FIXTURE_COUNT 16
@@ -53,7 +111,7 @@ const PROGMEM uint8_t colors[][3] = {
 
 typedef struct {
   uint8_t fixture_type;
-  uint8_t fixture_base_address;
+  uint16_t fixture_base_address;
 } fixture_data;
 
 /**
@@ -64,18 +122,20 @@ typedef struct {
  * different lights listening on channels 32, 33, 34, that's still a single
  * fixture from this perspective.
  * 
- * Each fixture is defined as a type (RGB or white) and a base address.  This is
- * the base for the RED channel, on a RGB fixture, or the brightness channel for
- * white fixtures.  If you have other channels that need to be fixed to certain
- * values (mode or grand master channels, for instance), set those in
- * fixed_channels.h - this doesn't handle setting goofy side values on some of
- * the RGB fixtures out there.
+ * Each fixture is defined as a type (from the list at the top) and a base
+ * address.  This is the first channel in the type's profile: the RED channel on
+ * a RGB fixture, or the brightness channel for white fixtures.  The channels of
+ * a 16-bit dimmer can't be used by anything else in the headers (scenes, fixed
+ * channels, HTP channels, or another fixture).  If you have other channels
+ * that need to be fixed to certain values (mode or grand master channels, for
+ * instance), set those in fixed_channels.h - this doesn't handle setting goofy
+ * side values on some of the RGB fixtures out there.
  * 
  * Note that MIDI channels are from 1-16.  These are labeled as such.  Really
  * the offset is a normal zero indexed array.
  */
 
-const PROGMEM fixture_data fixtures[MAX_FIXTURE_COUNT] = {
+constexpr PROGMEM fixture_data fixtures[MAX_FIXTURE_COUNT] = {
   {FIXTURE_RGB,      1}, //  1: Wash lights
   {FIXTURE_RGB,     66}, //  2: Stage Side Bars
   {FIXTURE_RGB,      8}, //  3: Stage Center Bars
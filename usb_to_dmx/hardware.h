@@ -0,0 +1,207 @@
+#ifndef __HARDWARE_H__
+#define __HARDWARE_H__
+
+/**
+ * Hardware access.  Everything the converter does with the EEPROM, the MIDI
+ * input, and the DMX output goes through here, and this is the only file that
+ * uses the libraries that drive them.  The rest of the code is just lighting
+ * logic, and only needs the basic Arduino types, PROGMEM access, and millis()
+ * and micros().
+ * 
+ * The DMX output is either DmxMaster, or the hardware UART (DMX_OUTPUT_UART).
+ * 
+ * To build the lighting logic for something other than the converter, replace
+ * this file with one that provides the same functions and dmxBuffer.  The host
+ * build does this with host/hardware.h, to replay recorded MIDI on a PC.
+ */
+
+#include <EEPROM.h>
+#include <util/crc16.h>
+
+#ifdef USE_USB_MIDI
+// REQUIRES LIBRARY:
+// https://github.com/arduino-libraries/MIDIUSB
+#include <MIDIUSB.h>
+#endif
+
+#ifdef DMX_OUTPUT_UART
+#include "dmx_uart.h"
+
+// The UART output knows when each frame is done, so the fader runs off that.
+#define DMX_OUTPUT_COUNTS_FRAMES
+#else
+// REQUIRES LIBRARY:
+// https://github.com/TinkerKit/DmxMaster
+#include <DmxMaster.h>
+
+/**
+ * Extern memory buffer defined in DmxMaster.cpp.  To avoid any blips in the
+ * lighting output on a restart, the stored values are put into this buffer
+ * directly before starting the DMX output signal.  Lights will hold onto the
+ * old value if they do not receive an update, but DmxMaster initializes the
+ * buffer to all 0s, so updating with the normal writes, while the output is
+ * alive, could cause a visible glitch in the lighting.  By writing the values
+ * here, the lighting will always stay where it was before (unless power is
+ * interrupted in the middle of a fade - then the old scene will load).
+ * 
+ * The fader writes this directly, with the masters applied.  The DmxMaster
+ * interrupt only ever reads it, a byte at a time, and a byte write can't be
+ * interrupted halfway through on the AVR, so there's no need to turn
+ * interrupts off around any of this.  A channel just goes out with either the
+ * old or the new value in the frame being sent.
+ * 
+ * DMX_SIZE is defined in DmxMaster.h
+ */
+extern volatile uint8_t dmxBuffer[DMX_SIZE];
+#endif
+
+/**
+ * EEPROM access.  Writes take about 3.5ms, and the EEPROM can't be read or
+ * written again until the last write is done, so check eeprom_write_done()
+ * before each write if waiting around for it isn't an option.
+ */
+inline byte read_eeprom(const uint16_t offset) {
+  return EEPROM[offset];
+}
+
+inline void update_eeprom(const uint16_t offset, const byte value) {
+  EEPROM.update(offset, value);
+}
+
+inline uint16_t eeprom_length() {
+  return EEPROM.length();
+}
+
+inline bool eeprom_write_done() {
+  return eeprom_is_ready();
+}
+
+/**
+ * CRC-8 used for the EEPROM log records.  avr-libc has a nice fast one.
+ */
+inline byte crc8_update(const byte crc, const byte data) {
+  return _crc8_ccitt_update(crc, data);
+}
+
+/**
+ * Start sending out DMX frames, with the given number of channels in each one.
+ * Whatever is in dmxBuffer goes out from the first frame.  This is the only
+ * thing that differs between the DMX outputs - after this, both of them just
+ * keep sending whatever is in dmxBuffer.
+ */
+inline void start_dmx_output(const uint16_t channels) {
+#ifdef DMX_OUTPUT_UART
+  start_dmx_uart(channels);
+#else
+  DmxMaster.maxChannel(channels);
+#endif
+}
+
+/**
+ * Change the number of channels in each DMX frame, while the output is running.
+ * The frame being sent carries on as it was, and the next one has the new
+ * length.
+ */
+inline void set_dmx_output_channels(const uint16_t channels) {
+#ifdef DMX_OUTPUT_UART
+  set_dmx_uart_channels(channels);
+#else
+  DmxMaster.maxChannel(channels);
+#endif
+}
+
+#ifdef DMX_OUTPUT_COUNTS_FRAMES
+/**
+ * The number of DMX frames that have gone out, counting up from when the output
+ * started and wrapping at 256.  It only needs comparing with the last count to
+ * see if another frame is done.  It's a single byte, so it can be read with
+ * interrupts on.
+ */
+inline byte get_dmx_frame_count() {
+  return dmx_uart_frame_count;
+}
+#endif
+
+#ifdef USE_USB_MIDI
+/**
+ * USB MIDI packets.  If there is no packet to be read, the header is zero.
+ * Sent packets are held until the flush.
+ */
+inline midiEventPacket_t read_usb_midi() {
+  return MidiUSB.read();
+}
+
+inline void send_usb_midi(const midiEventPacket_t packet) {
+  MidiUSB.sendMIDI(packet);
+}
+
+inline void flush_usb_midi() {
+  MidiUSB.flush();
+}
+
+/**
+ * MIDIUSB keeps the number of its send endpoint to itself, but the send space
+ * check needs it.  A class derived from MIDI_ can get at it, and it's one past
+ * the receive endpoint, as in MIDIUSB.cpp.
+ */
+struct usb_midi_endpoint : MIDI_ {
+  static uint8_t send(MIDI_ &midi) {
+    return midi.*(&usb_midi_endpoint::pluggedEndpoint) + 1;
+  }
+};
+
+/**
+ * How many more packets fit in the USB send buffer (one 64 byte endpoint
+ * bank) before sending waits on the host.  MidiUSB.sendMIDI() waits for room,
+ * for up to 250ms a packet, so anything the host hasn't asked for (the
+ * telemetry) checks this first, and is skipped if there isn't room for all of
+ * it.  With the USB cable pulled, or the host not reading, there's never room.
+ */
+#define USB_MIDI_SEND_BUFFER_PACKETS (64 / sizeof(midiEventPacket_t))
+
+inline byte usb_midi_send_space() {
+  return USB_SendSpace(usb_midi_endpoint::send(MidiUSB)) /
+          sizeof(midiEventPacket_t);
+}
+
+// Turn off the blinding red LEDs on the Pro Micro platform.
+inline void turn_off_leds() {
+  TXLED1;
+  RXLED1;
+}
+#endif
+
+#ifdef USE_SERIAL_MIDI
+// On the boards with native USB (the 32U4), Serial is the USB serial port, and
+// the hardware serial port on the RX pin is Serial1.
+#ifdef USBCON
+#define MIDI_SERIAL Serial1
+#else
+#define MIDI_SERIAL Serial
+#endif
+
+/**
+ * Serial MIDI is read a byte at a time from the hardware serial port, at the
+ * MIDI baud rate of 31.25kHz.  The RX pin is pulled up, so a unit without
+ * anything plugged into the DIN socket sees an idle line, not noise.
+ */
+inline void start_serial_midi() {
+  pinMode(0, INPUT_PULLUP);
+  MIDI_SERIAL.begin(31250);
+}
+
+inline bool serial_midi_available() {
+  return MIDI_SERIAL.available();
+}
+
+inline byte read_serial_midi() {
+  return MIDI_SERIAL.read();
+}
+
+// Only the sync master sends anything, and only single bytes.
+inline void send_serial_midi(const byte value) {
+  MIDI_SERIAL.write(value);
+}
+#endif
+
+#endif // __HARDWARE_H__
@@ -0,0 +1,212 @@
+#ifndef __HOST_HARDWARE_H__
+#define __HOST_HARDWARE_H__
+
+/**
+ * Stand-in hardware, for building the converter on a PC.  This provides the
+ * same functions as ../hardware.h, and the few bits of Arduino the rest of the
+ * code needs, but everything is kept in memory: the EEPROM is an array, the USB
+ * MIDI input is a queue of packets to hand over at given times, and dmxBuffer
+ * is just a buffer.  See replay.cpp for what drives it.
+ * 
+ * The sketch is built into one program with the driver, so the state is simply
+ * defined here.  Everything in it starts with host_, and the driver is free to
+ * look at or change any of it.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <deque>
+
+#ifdef PRINT_STATE
+#error "PRINT_STATE needs a serial port, and the host build doesn't have one"
+#endif
+
+typedef uint8_t byte;
+
+// Everything is in the one address space, so PROGMEM is just memory.
+#define PROGMEM
+#define pgm_read_byte_near(address) (*(const uint8_t *)(address))
+#define pgm_read_word_near(address) (*(const uint16_t *)(address))
+#define memcpy_P memcpy
+
+/**
+ * The clock.  Nothing the converter does takes any time here, so each read of
+ * the clock moves it on by HOST_MICROS_PER_READ - else the wait for the next
+ * frame in loop() would never end.  It's kept as 64 bits so millis() wraps
+ * where it does on the converter, not when micros() does.
+ */
+#define HOST_MICROS_PER_READ 4
+uint64_t host_micros = 0;
+
+inline uint32_t micros() {
+  host_micros += HOST_MICROS_PER_READ;
+  return (uint32_t)host_micros;
+}
+
+inline uint32_t millis() {
+  return (uint32_t)(micros() / 1000);
+}
+
+inline void delay(const uint32_t ms) {
+  host_micros += (uint64_t)ms * 1000;
+}
+
+/**
+ * The EEPROM, as the 1KB on the 32U4, erased (all 0xff) to start with.  Each
+ * write that changes a byte is counted, and keeps the EEPROM busy for
+ * HOST_EEPROM_WRITE_MICROS, as on the converter.  A write while it's busy
+ * waits for the last one to finish first, which is what the AVR does too.
+ */
+#define HOST_EEPROM_SIZE 1024
+#define E2END (HOST_EEPROM_SIZE - 1)
+#define HOST_EEPROM_WRITE_MICROS 3400
+byte host_eeprom[HOST_EEPROM_SIZE];
+uint32_t host_eeprom_writes = 0;
+uint64_t host_eeprom_busy_until = 0;
+
+inline byte read_eeprom(const uint16_t offset) {
+  return host_eeprom[offset];
+}
+
+inline void update_eeprom(const uint16_t offset, const byte value) {
+  if (host_eeprom[offset] == value) return;
+  
+  if (host_micros < host_eeprom_busy_until) {
+    host_micros = host_eeprom_busy_until;
+  }
+  host_eeprom[offset] = value;
+  host_eeprom_writes++;
+  host_eeprom_busy_until = host_micros + HOST_EEPROM_WRITE_MICROS;
+}
+
+inline uint16_t eeprom_length() {
+  return HOST_EEPROM_SIZE;
+}
+
+inline bool eeprom_write_done() {
+  return host_micros >= host_eeprom_busy_until;
+}
+
+/**
+ * The same CRC-8 as avr-libc's _crc8_ccitt_update(), so an EEPROM image from a
+ * converter can be loaded in.
+ */
+inline byte crc8_update(byte crc, const byte data) {
+  crc ^= data;
+  for (byte i = 0; i < 8; i++) {
+    crc = (crc & 0x80) ? (byte)((crc << 1) ^ 0x07) : (byte)(crc << 1);
+  }
+  return crc;
+}
+
+/**
+ * The DMX output.  Nothing is sent anywhere - the driver just looks at
+ * dmxBuffer, and the number of channels that would go out in each frame.
+ * 
+ * With DMX_OUTPUT_UART, the frames are counted as they'd finish from the UART:
+ * the break and mark after break, then the start code and the channel slots.
+ */
+#define DMX_SIZE 512
+volatile uint8_t dmxBuffer[DMX_SIZE];
+uint16_t host_dmx_channels = 0;
+
+#ifdef DMX_OUTPUT_UART
+#define DMX_OUTPUT_COUNTS_FRAMES
+#define HOST_DMX_FRAME_MICROS(channels) (100 + ((uint32_t)(channels) + 1) * 44)
+byte host_dmx_frame_count = 0;
+uint64_t host_dmx_frame_end = 0;
+
+inline byte get_dmx_frame_count() {
+  while (host_micros >= host_dmx_frame_end) {
+    host_dmx_frame_count++;
+    host_dmx_frame_end += HOST_DMX_FRAME_MICROS(host_dmx_channels);
+  }
+  return host_dmx_frame_count;
+}
+#endif
+
+inline void start_dmx_output(const uint16_t channels) {
+  host_dmx_channels = channels;
+#ifdef DMX_OUTPUT_UART
+  host_dmx_frame_end = host_micros + HOST_DMX_FRAME_MICROS(channels);
+#endif
+}
+
+inline void set_dmx_output_channels(const uint16_t channels) {
+  host_dmx_channels = channels;
+}
+
+#ifdef USE_USB_MIDI
+/**
+ * USB MIDI.  Each packet in host_usb_input is handed over once the clock gets
+ * to its time, in order.  Sent packets are only counted, and never fill up the
+ * send buffer, so the send space stays at whatever the driver sets.
+ */
+typedef struct {
+  uint8_t header;
+  uint8_t byte1;
+  uint8_t byte2;
+  uint8_t byte3;
+} midiEventPacket_t;
+
+typedef struct {
+  uint64_t micros;
+  midiEventPacket_t packet;
+} host_usb_packet;
+
+std::deque<host_usb_packet> host_usb_input;
+uint32_t host_usb_packets_sent = 0;
+
+// Room in the send buffer, in packets.  0 is a host that isn't reading.
+#define USB_MIDI_SEND_BUFFER_PACKETS 16
+byte host_usb_send_space = USB_MIDI_SEND_BUFFER_PACKETS;
+
+inline midiEventPacket_t read_usb_midi() {
+  midiEventPacket_t packet = {0, 0, 0, 0};
+  
+  if (!host_usb_input.empty() &&
+          host_usb_input.front().micros <= host_micros) {
+    packet = host_usb_input.front().packet;
+    host_usb_input.pop_front();
+  }
+  return packet;
+}
+
+inline void send_usb_midi(const midiEventPacket_t) {
+  host_usb_packets_sent++;
+}
+
+inline void flush_usb_midi() {
+}
+
+inline byte usb_midi_send_space() {
+  return host_usb_send_space;
+}
+
+inline void turn_off_leds() {
+}
+#endif
+
+#ifdef USE_SERIAL_MIDI
+/**
+ * Serial MIDI.  Nothing ever comes in, and the bytes sent are only counted.
+ */
+uint32_t host_serial_bytes_sent = 0;
+
+inline void start_serial_midi() {
+}
+
+inline bool serial_midi_available() {
+  return false;
+}
+
+inline byte read_serial_midi() {
+  return 0;
+}
+
+inline void send_serial_midi(const byte) {
+  host_serial_bytes_sent++;
+}
+#endif
+
+#endif // __HOST_HARDWARE_H__
@@ -0,0 +1,314 @@
+/**
+ * Replay recorded MIDI through the converter on a PC, and report what each
+ * frame cost, where the lights ended up, and how many EEPROM writes it took.
+ * This is for trying out a change to the fader or the EEPROM log without
+ * flashing a converter and sitting through the cues - run the same stream
+ * before and after, and compare.  See the Makefile for building it.
+ * 
+ * Usage: replay [-e eeprom.bin] [-s send_space] [-t settle_millis]
+ *         [-x expected] [stream]
+ * 
+ * The stream (standard input if not given) is one MIDI message per line:
+ * 
+ *   <micros> <status> <data0> <data1>
+ * 
+ * The time is in microseconds from when the converter starts, and the bytes
+ * are in hex.  With four bytes, it's a raw USB MIDI packet, header first, which
+ * is how to send a SysEx request.  A line can also be a MIDI capture reply (see
+ * send_midi_capture_part() in the sketch), as the hex bytes from F0 to F7.  The
+ * commands in that are replayed at the times they came in, relative to the
+ * first, which goes in after everything before it.  Anything after a # is a
+ * comment.  The lines must be in time order.
+ * 
+ * Once the stream is all in, it keeps running for settle_millis (default
+ * 10000), so the fades finish and the EEPROM log catches up, and then reports.
+ * 
+ * With -e, the EEPROM is loaded from the image before starting (if it's
+ * there), and saved back to it at the end, so the next replay starts from
+ * where this one left the lights.
+ * 
+ * -s sets how many packets the USB send buffer has room for (default 16, all
+ * of it).  0 is a host that has stopped reading.
+ * 
+ * With -x, the final DMX output is checked against the expected file, and the
+ * replay fails (exit status 1) if any channel, or the number of channels, is
+ * different.  The file is in the same form as the DMX dump in the report - the
+ * first channel on the line, a colon, and then the values in hex - so a
+ * replay's own dump can be kept as the expected result for the next one.
+ */
+
+#define HOST_BUILD
+#include "../usb_to_dmx.ino"
+
+#ifndef USE_USB_MIDI
+#error "The replay sends the stream in over USB MIDI, so needs USE_USB_MIDI"
+#endif
+
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <strings.h>
+#include <unistd.h>
+
+#define REPLAY_LINE_SIZE 1024
+#define REPLAY_DEFAULT_SETTLE_MILLIS 10000
+
+// The MIDI status byte for each command code, to turn a capture back into
+// what the converter was sent.  See decode_midi_command().
+static const byte replay_command_status[] = {
+  0, 0x90, 0x80, 0xb0, 0xc0, 0xa0, 0xd0
+};
+
+/**
+ * Add a packet to the USB input, at the given time after the start.
+ */
+static void replay_add_packet(const uint64_t at, const byte header,
+        const byte byte1, const byte byte2, const byte byte3) {
+  host_usb_packet input = {at, {header, byte1, byte2, byte3}};
+  
+  host_usb_input.push_back(input);
+}
+
+/**
+ * Add the commands in a MIDI capture reply.  The captured times are 28 bits of
+ * micros(), so they're taken from the first one, allowing for them wrapping.
+ * 
+ * @param bytes The reply, from the F0 to the F7.
+ * @param length The number of bytes.
+ * @param at The time to put the first command at, and filled in with the time
+ *        of the last one.
+ * @return False if the reply doesn't make sense.
+ */
+static bool replay_add_capture(const byte *bytes, const int length,
+        uint64_t *at) {
+  const int entry_length = 11;
+  uint32_t first_micros = 0;
+  int count;
+  
+  if (length < 5 || bytes[1] != SYSEX_ID_NON_COMMERCIAL ||
+          bytes[2] != SYSEX_READ_CAPTURE) {
+    return false;
+  }
+  count = bytes[3];
+  if (length != 5 + count * entry_length) return false;
+  
+  for (int i = 0; i < count; i++) {
+    const byte *entry = bytes + 4 + i * entry_length;
+    uint32_t received_micros = 0;
+    byte status;
+  
+    if (!entry[0] || entry[0] >= sizeof(replay_command_status)) return false;
+    for (int j = 3; j >= 0; j--) {
+      received_micros = (received_micros << 7) | entry[4 + j];
+    }
+    if (i == 0) first_micros = received_micros;
+  
+    status = replay_command_status[entry[0]] | (entry[1] & 0xf);
+    replay_add_packet(*at + ((received_micros - first_micros) & 0xfffffff),
+            status >> 4, status, entry[2], entry[3]);
+  }
+  if (count) *at = host_usb_input.back().micros;
+  return true;
+}
+
+/**
+ * Read the expected DMX output, in the form the report prints it in.
+ * 
+ * @param values Filled in with the expected value of each channel.
+ * @param channels Filled in with the number of channels.
+ * @return False if there's a bad line.
+ */
+static bool replay_read_expected(FILE *expected, byte *values,
+        uint16_t *channels) {
+  char line[REPLAY_LINE_SIZE];
+  int line_number = 0;
+  
+  *channels = 0;
+  while (fgets(line, sizeof(line), expected)) {
+    char *word, *end;
+    unsigned long channel;
+    
+    line_number++;
+    if ((end = strchr(line, '#'))) *end = 0;
+    if (!(word = strtok(line, " \t\r\n"))) continue;
+    
+    channel = strtoul(word, &end, 10);
+    if (*end != ':' || channel != *channels + 1u) {
+      fprintf(stderr, "expected line %d: should start with channel %u:\n",
+              line_number, *channels + 1);
+      return false;
+    }
+    while ((word = strtok(NULL, " \t\r\n"))) {
+      if (*channels >= DMX_SIZE) {
+        fprintf(stderr, "expected line %d: too many channels\n", line_number);
+        return false;
+      }
+      values[(*channels)++] = strtoul(word, &end, 16);
+    }
+  }
+  return true;
+}
+
+/**
+ * Check the DMX output against the expected values, and print out every
+ * channel that's different.
+ * 
+ * @return True if they all match.
+ */
+static bool replay_check_expected(const byte *values, const uint16_t channels) {
+  bool match = true;
+  
+  if (channels != host_dmx_channels) {
+    fprintf(stderr, "mismatch: %u dmx channels, expected %u\n",
+            host_dmx_channels, channels);
+    match = false;
+  }
+  for (uint16_t i = 0; i < channels && i < host_dmx_channels; i++) {
+    if (dmxBuffer[i] != values[i]) {
+      fprintf(stderr, "mismatch: channel %u is %02x, expected %02x\n",
+              i + 1, dmxBuffer[i], values[i]);
+      match = false;
+    }
+  }
+  return match;
+}
+
+/**
+ * Read the stream into the USB input.
+ * 
+ * @return The time of the last packet, or -1 if there's a bad line.
+ */
+static int64_t replay_read_stream(FILE *stream) {
+  char line[REPLAY_LINE_SIZE];
+  uint64_t last = 0;
+  int line_number = 0;
+  
+  while (fgets(line, sizeof(line), stream)) {
+    byte bytes[REPLAY_LINE_SIZE / 2];
+    int length = 0;
+    char *word, *end;
+    uint64_t at = last;
+  
+    line_number++;
+    if ((end = strchr(line, '#'))) *end = 0;
+    if (!(word = strtok(line, " \t\r\n"))) continue;
+  
+    // A capture reply starts with the SysEx start, anything else with a time.
+    bool capture = !strcasecmp(word, "f0");
+    if (!capture) {
+      at = strtoull(word, &end, 10);
+      word = strtok(NULL, " \t\r\n");
+    }
+    for (; word; word = strtok(NULL, " \t\r\n")) {
+      bytes[length++] = strtoul(word, &end, 16);
+    }
+  
+    if (capture) {
+      if (!replay_add_capture(bytes, length, &at)) {
+        fprintf(stderr, "line %d: not a MIDI capture reply\n", line_number);
+        return -1;
+      }
+    } else if (at < last) {
+      fprintf(stderr, "line %d: out of time order\n", line_number);
+      return -1;
+    } else if (length == 3) {
+      replay_add_packet(at, bytes[0] >> 4, bytes[0], bytes[1], bytes[2]);
+    } else if (length == 4) {
+      replay_add_packet(at, bytes[0], bytes[1], bytes[2], bytes[3]);
+    } else {
+      fprintf(stderr, "line %d: expected 3 or 4 bytes\n", line_number);
+      return -1;
+    }
+    last = at;
+  }
+  return last;
+}
+
+int main(int argc, char **argv) {
+  const char *eeprom_image = NULL;
+  byte expected_values[DMX_SIZE];
+  uint16_t expected_channels = 0;
+  bool expected = false, match = true;
+  uint32_t settle_millis = REPLAY_DEFAULT_SETTLE_MILLIS;
+  FILE *stream = stdin, *image, *expected_file;
+  int64_t last;
+  uint64_t start, end, frames = 0;
+  double total_nanos = 0, max_nanos = 0;
+  int option;
+  
+  while ((option = getopt(argc, argv, "e:s:t:x:")) != -1) {
+    if (option == 'e') {
+      eeprom_image = optarg;
+    } else if (option == 's') {
+      host_usb_send_space = strtoul(optarg, NULL, 10);
+    } else if (option == 't') {
+      settle_millis = strtoul(optarg, NULL, 10);
+    } else if (option == 'x') {
+      if (!(expected_file = fopen(optarg, "r"))) {
+        perror(optarg);
+        return 2;
+      }
+      expected = replay_read_expected(expected_file, expected_values,
+              &expected_channels);
+      fclose(expected_file);
+      if (!expected) return 2;
+    } else {
+      fprintf(stderr, "usage: %s [-e eeprom.bin] [-s send_space] "
+              "[-t settle_millis] [-x expected] [stream]\n", argv[0]);
+      return 2;
+    }
+  }
+  if (optind < argc && !(stream = fopen(argv[optind], "r"))) {
+    perror(argv[optind]);
+    return 2;
+  }
+  if ((last = replay_read_stream(stream)) < 0) return 1;
+  
+  memset(host_eeprom, 0xff, sizeof(host_eeprom));
+  if (eeprom_image && (image = fopen(eeprom_image, "rb"))) {
+    fread(host_eeprom, 1, sizeof(host_eeprom), image);
+    fclose(image);
+  }
+  
+  // The stream times are from the start of the loop, so the time setup() takes
+  // (the boot delay, if there is one) isn't in them.
+  setup();
+  start = host_micros;
+  for (auto &input : host_usb_input) {
+    input.micros += start;
+  }
+  end = start + last + (uint64_t)settle_millis * 1000;
+  
+  while (host_micros < end) {
+    auto before = std::chrono::steady_clock::now();
+    loop();
+    double nanos = std::chrono::duration<double, std::nano>(
+            std::chrono::steady_clock::now() - before).count();
+  
+    frames++;
+    total_nanos += nanos;
+    if (nanos > max_nanos) max_nanos = nanos;
+  }
+  
+  printf("frames: %llu\n", (unsigned long long)frames);
+  printf("frame cost: %.0f ns mean, %.0f ns max\n",
+          frames ? total_nanos / frames : 0, max_nanos);
+  printf("eeprom writes: %u\n", host_eeprom_writes);
+  printf("usb packets sent: %u\n", host_usb_packets_sent);
+  printf("dmx channels: %u\n", host_dmx_channels);
+  for (uint16_t i = 0; i < host_dmx_channels; i++) {
+    if (i % 16 == 0) printf("%03u:", i + 1);
+    printf(" %02x", dmxBuffer[i]);
+    if (i % 16 == 15 || i == host_dmx_channels - 1) printf("\n");
+  }
+  
+  if (eeprom_image && (image = fopen(eeprom_image, "wb"))) {
+    fwrite(host_eeprom, 1, sizeof(host_eeprom), image);
+    fclose(image);
+  }
+  
+  if (expected) {
+    match = replay_check_expected(expected_values, expected_channels);
+  }
+  return match ? 0 : 1;
+}
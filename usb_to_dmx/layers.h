@@ -0,0 +1,55 @@
+#ifndef __LAYERS_H__
+#define __LAYERS_H__
+
+/**
+ * Output layers.  Each of the ways of setting a channel has its own layer, and
+ * every channel keeps a value for each layer that has set it.  What actually
+ * goes out on the channel is worked out from those:
+ * 
+ * - Most channels are "latest takes precedence" (LTP): whichever layer set the
+ *   channel most recently wins, which is how everything has always worked.
+ * - Channels in the htp_channels list below are "highest takes precedence"
+ *   (HTP): the brightest of the layers wins, no matter which came last.  This
+ *   is for brightness channels, where a fixture command should be able to bring
+ *   a light up over a scene without the next scene pulling it back down.
+ * 
+ * The layers, from the bottom up, are the fixed channels, the scenes (and
+ * chases), the fixture commands, and the raw DMX channel commands.  The fixture
+ * and raw layers are overrides: they can be released with a "Channel Pressure"
+ * command, and the channels they were holding go back to whatever the layers
+ * below them say, without having to send the scene again.  Channel 1 releases
+ * the fixture overrides, and channel 2 the raw DMX channel overrides.  The
+ * "Pressure" is the fade time.
+ */
+
+#define LAYER_FIXED 0
+#define LAYER_SCENE 1
+#define LAYER_FIXTURE 2
+#define LAYER_RAW 3
+#define LAYER_COUNT 4
+
+// The first layer that can be released.
+#define LAYER_FIRST_OVERRIDE LAYER_FIXTURE
+
+/**
+ * The DMX channels that are "highest takes precedence".  To add one, add its
+ * DMX channel to the list, above the 0 that ends it.  Channels that aren't in
+ * the headers are fine - they just don't do anything until they are set in raw
+ * DMX channel mode.
+ * 
+ * The list is empty to start with, so every channel works the way it always
+ * has.  Making a channel HTP changes what the existing cues do to it: a fixture
+ * command can't take it below what the scene has it at, and once a fixture
+ * command has brought it up, no scene can take it down until the fixture
+ * overrides are released - and cues written before the layers never send the
+ * release.  Only add a channel once its cues have been looked over.
+ */
+constexpr PROGMEM uint16_t htp_channels[] = {
+  //4, // White stage spotlights
+  //6, // White congregation overhead lights
+  0, // End of the list
+};
+
+#define HTP_CHANNEL_COUNT (sizeof(htp_channels) / sizeof(uint16_t) - 1)
+
+#endif // __LAYERS_H__
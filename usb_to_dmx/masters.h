@@ -0,0 +1,58 @@
+#ifndef __MASTERS_H__
+#define __MASTERS_H__
+
+/**
+ * Grand master and submasters.  These dim the lights as they go out, without
+ * changing the scene or anything else that set them, so the whole room can be
+ * taken down to half with one MIDI message and brought back up with another.
+ *
+ * The grand master dims every channel except the fixed channels (which are
+ * usually modes and such that must not change).  Each submaster dims the
+ * channels in its group, listed below, on top of the grand master.  All the
+ * masters start at full, and are stored and restored like the channels.
+ *
+ * To set a master from Proclaim, send a "Control Change" on MIDI channel 16:
+ * the "Number" is the master (0 for the grand master, or the submaster), and
+ * the "Value" is the level (0-127, scaled like the other brightness values).
+ * The master fades to the new level over MASTER_FADE_MILLIS.
+ *
+ * That takes MIDI channel 16 away from raw DMX channel mode.  Before the
+ * masters, a Control Change on any channel was a raw DMX channel write (the
+ * MIDI channel only picks the fade curve, and anything past the curves is
+ * linear), so a cue that sends raw DMX channels on channel 16 now sets the
+ * masters instead.  Send those on channel 1 for the same linear fade, or move
+ * MASTER_MIDI_CHANNEL to a channel the cues don't use.  It can't be one of the
+ * fade curve channels.
+ */
+
+#define SUBMASTER_COUNT 3
+#define MASTER_COUNT (SUBMASTER_COUNT + 1)
+#define GRAND_MASTER 0
+
+// MIDI channel 16, but everything is 0 indexed in C.  Reserved for the
+// masters - raw DMX channel writes on it are taken as master levels.
+#define MASTER_MIDI_CHANNEL 15
+
+#define MASTER_FADE_MILLIS 1000
+
+typedef struct {
+  uint16_t channel; // DMX channel (1-512)
+  byte submaster; // Submaster (1-SUBMASTER_COUNT)
+} submaster_channel;
+
+/**
+ * The channels in each submaster group.  To add a channel to a group, copy an
+ * existing line and change the values.  A channel can only be in one group.
+ */
+constexpr PROGMEM submaster_channel submaster_channels[] = {
+  {1, 1}, {2, 1}, {3, 1}, // 1: Stage - edge lights
+  {8, 1}, {9, 1}, {10, 1}, // 1: Stage - center lights
+  {4, 1}, // 1: Stage - spotlights
+  {6, 2}, // 2: House - overhead lights
+  {66, 3}, {67, 3}, {68, 3}, // 3: Side wash lights
+};
+
+#define SUBMASTER_CHANNEL_COUNT (sizeof(submaster_channels) /                  \
+        sizeof(submaster_channel))
+
+#endif // __MASTERS_H__
@@ -25,21 +25,17 @@
  * 8, 9, 10: RGB "stage center" lights
  */
 
-// Set this to however many scenes you have defined below.
+// This is the number of scenes that can be selected - one for each MIDI note.
 #define MAX_SCENE_COUNT 128
 
-// This must be set to the number of unique channels being controlled.
-// In the example/my setup, this is 11 channels.
-#define MAX_UNIQUE_CHANNELS 11
-
 /**
  * The definitions here are the tricky part, and are tricky mostly because of
  * the C++ standards for sparse array are worse than in C, especially GNU C.
  * 
  * What's happening is that the scene array is being initialized with a series
  * of values in sequential order, but the illusion is given of specifying
- * brightness or color values for each fixture.  A set of defines and a
- * conversion array accomplish this slightly easier to read format.  But,
+ * brightness or color values for each fixture.  A list of fixtures and the
+ * channels they use accomplishes this slightly easier to read format.  But,
  * realistically, someone who knows C is probably going to have to set this up
  * the first time.
  * 
@@ -50,18 +46,21 @@
  * And the brightness defines are a single value:
  * #define BRIGHTNESS_HIGH 192
  * 
- * The scene_slot_to_channel_mapping translates from the position of the value
+ * The SCENE_SLOTS list (below) names each fixture used in the scenes, and lists
+ * the DMX channels it controls.  From this, the compiler works out the position
+ * ("slot") of each fixture in the scenes, the number of slots, and the
+ * scene_slot_to_channel_mapping that translates from the position of the value
  * in each scene to the DMX channel controlled by that position - so, for my
  * example, position 0 (stage spots) is actually controlling DMX channel 4.
  * 
- * For single channel fixtures, you only need one entry.  For RGB fixtures, you
- * need three (one for each channel).  The defines are in R, G, B order, so if
+ * For single channel fixtures, you only need one channel.  For RGB fixtures,
+ * you need three (one for each color).  The defines are in R, G, B order, so if
  * you have some bizarre fixture that doesn't have them aligned the same way,
- * this allows you to twiddle the values around and line things up so they work.
+ * this allows you to twiddle the channels around and line things up so they
+ * work.
  * 
- * Once each of these entries is defined, create a define (below) to indicate
- * the position that each field starts in.  This allows you to define scene
- * arrays that are reasonably readable.
+ * Adding a fixture is just adding a line to the list.  The build checks that
+ * every channel is a valid DMX channel, and that no channel is listed twice.
  * 
  * What actually happens, if you take the example scene 1, is this:
  * [1] = {
@@ -76,8 +75,9 @@
  * an error:
  * sorry, unimplemented: non-trivial designated initializers not supported
  * 
- * That means that you need to go through and check your mappings again, because
- * there's a gap somewhere.
+ * The slots can't have gaps any more, so that means that one of the scenes is
+ * missing a fixture, or has them out of order - every scene needs every
+ * fixture, in the same order as the SCENE_SLOTS list.
  * 
  * Alternately, if you wanted, you could just define scene 1 like this:
  * 
@@ -97,30 +97,52 @@
  * 
  * Regardless of what method you use, go about setting up your scenes as
  * desired, and things should work!
+ * 
+ * Most of the 128 scenes are usually either unused (all off) or copies of each
+ * other, and flash is tight on the 32U4, so the scenes aren't stored as one big
+ * 128 scene array.  Each different scene is written once, as a "row" in the
+ * scene_rows array, and the scene_index array (at the bottom of this file)
+ * says which row each scene uses.  If you add a new row, add it to the end of
+ * scene_rows, and point the scenes that should use it at the new row number.
+ * Rows can be shared by as many scenes as you like.
  */
 
-const PROGMEM byte scene_slot_to_channel_mapping[MAX_UNIQUE_CHANNELS] = {
-  4,          // STAGE_SPOTS
-  6,          // AUDIENCE_LIGHTS
-  66, 67, 68, // WASH_LIGHTS
-  1, 2, 3,    // STAGE_EDGE_BARS
-  8, 9, 10,   // STAGE_CENTER_BARS
-};
+#define SCENE_SLOTS(SLOT)                                                      \
+  SLOT(STAGE_SPOTS, 4)              /* White: Single channel */                \
+  SLOT(AUDIENCE_LIGHTS, 6)          /* White: Single channel */                \
+  SLOT(WASH_LIGHTS, 66, 67, 68)     /* RGB: 3 channels */                      \
+  SLOT(STAGE_EDGE_BARS, 1, 2, 3)    /* RGB: 3 channels */                      \
+  SLOT(STAGE_CENTER_BARS, 8, 9, 10) /* RGB: 3 channels */
 
-// White: Single channel
-#define STAGE_SPOTS 0
+/**
+ * Everything from here to the scenes is generated from the SCENE_SLOTS list,
+ * and shouldn't need to be touched.
+ * 
+ * Each fixture gets a slot number for the first of its channels, and a _LAST
+ * value for the last one, so the next fixture starts right after it.
+ */
+template <typename... Channels>
+constexpr byte count_scene_slot_channels(Channels...) {
+  return sizeof...(Channels);
+}
 
-// White: Single channel
-#define AUDIENCE_LIGHTS 1
+#define SCENE_SLOT_ENUM(name, ...) name,                                       \
+  name##_LAST = name + count_scene_slot_channels(__VA_ARGS__) - 1,
+#define SCENE_SLOT_CHANNELS(name, ...) __VA_ARGS__,
 
-// RGB: 3 channels - slots 2, 3, 4
-#define WASH_LIGHTS 2
+enum scene_slot {
+  SCENE_SLOTS(SCENE_SLOT_ENUM)
+  SCENE_SLOT_COUNT
+};
 
-// RGB: 3 channels, slots 5, 6, 7
-#define STAGE_EDGE_BARS 5
+// The number of unique channels being controlled.
+// In the example/my setup, this is 11 channels.
+#define MAX_UNIQUE_CHANNELS SCENE_SLOT_COUNT
 
-// RGB: 3 channels, slots 8, 9, 10
-#define STAGE_CENTER_BARS 8
+constexpr PROGMEM uint16_t
+        scene_slot_to_channel_mapping[MAX_UNIQUE_CHANNELS] = {
+  SCENE_SLOTS(SCENE_SLOT_CHANNELS)
+};
 
 /**
  * Involve Church setup:
@@ -151,8 +173,8 @@ const PROGMEM byte scene_slot_to_channel_mapping[MAX_UNIQUE_CHANNELS] = {
  */
 
 
-// Scenes!  Program at will.
-const PROGMEM byte scenes[MAX_SCENE_COUNT][MAX_UNIQUE_CHANNELS] = {
+// Scene rows!  Program at will.
+const PROGMEM byte scene_rows[][MAX_UNIQUE_CHANNELS] = {
   // Scene 0: Lights off.  Scene 0 is always everything off.
   [0] = {
     [STAGE_SPOTS] = BRIGHTNESS_OFF,
@@ -489,7 +511,7 @@ const PROGMEM byte scenes[MAX_SCENE_COUNT][MAX_UNIQUE_CHANNELS] = {
     [STAGE_EDGE_BARS] = COLOR_OFF,
     [STAGE_CENTER_BARS] = COLOR_OFF,
   },
-  // Scene 42: Sermon 10
+  // Scene 42: Sermon 10 (and Sermon 11-16)
   [42] = {
     [STAGE_SPOTS] = BRIGHTNESS_HIGH,
     [AUDIENCE_LIGHTS] = BRIGHTNESS_LED_SERMON,
@@ -497,464 +519,8 @@ const PROGMEM byte scenes[MAX_SCENE_COUNT][MAX_UNIQUE_CHANNELS] = {
     [STAGE_EDGE_BARS] = COLOR_OFF,
     [STAGE_CENTER_BARS] = COLOR_OFF,
   },
-  // Scene 43: Sermon 11
-  [43] = {
-    [STAGE_SPOTS] = BRIGHTNESS_HIGH,
-    [AUDIENCE_LIGHTS] = BRIGHTNESS_LED_SERMON,
-    [WASH_LIGHTS] = COLOR_OFF,
-    [STAGE_EDGE_BARS] = COLOR_OFF,
-    [STAGE_CENTER_BARS] = COLOR_OFF,
-  },
-  // Scene 44: Sermon 12
-  [44] = {
-    [STAGE_SPOTS] = BRIGHTNESS_HIGH,
-    [AUDIENCE_LIGHTS] = BRIGHTNESS_LED_SERMON,
-    [WASH_LIGHTS] = COLOR_OFF,
-    [STAGE_EDGE_BARS] = COLOR_OFF,
-    [STAGE_CENTER_BARS] = COLOR_OFF,
-  },
-  // Scene 45: Sermon 13
-  [45] = {
-    [STAGE_SPOTS] = BRIGHTNESS_HIGH,
-    [AUDIENCE_LIGHTS] = BRIGHTNESS_LED_SERMON,
-    [WASH_LIGHTS] = COLOR_OFF,
-    [STAGE_EDGE_BARS] = COLOR_OFF,
-    [STAGE_CENTER_BARS] = COLOR_OFF,
-  },
-  // Scene 46: Sermon 14
-  [46] = {
-    [STAGE_SPOTS] = BRIGHTNESS_HIGH,
-    [AUDIENCE_LIGHTS] = BRIGHTNESS_LED_SERMON,
-    [WASH_LIGHTS] = COLOR_OFF,
-    [STAGE_EDGE_BARS] = COLOR_OFF,
-    [STAGE_CENTER_BARS] = COLOR_OFF,
-  },
-  // Scene 47: Sermon 15
-  [47] = {
-    [STAGE_SPOTS] = BRIGHTNESS_HIGH,
-    [AUDIENCE_LIGHTS] = BRIGHTNESS_LED_SERMON,
-    [WASH_LIGHTS] = COLOR_OFF,
-    [STAGE_EDGE_BARS] = COLOR_OFF,
-    [STAGE_CENTER_BARS] = COLOR_OFF,
-  },
-  // Scene 48: Sermon 16
-  [48] = {
-    [STAGE_SPOTS] = BRIGHTNESS_HIGH,
-    [AUDIENCE_LIGHTS] = BRIGHTNESS_LED_SERMON,
-    [WASH_LIGHTS] = COLOR_OFF,
-    [STAGE_EDGE_BARS] = COLOR_OFF,
-    [STAGE_CENTER_BARS] = COLOR_OFF,
-  },
-  // Scene 49:
-  [49] = {
-    [STAGE_SPOTS] = BRIGHTNESS_OFF,
-    [AUDIENCE_LIGHTS] = BRIGHTNESS_OFF,
-    [WASH_LIGHTS] = COLOR_OFF,
-    [STAGE_EDGE_BARS] = COLOR_OFF,
-    [STAGE_CENTER_BARS] = COLOR_OFF,
-  },
-  // Scene 50:
-  [50] = {
-    [STAGE_SPOTS] = BRIGHTNESS_OFF,
-    [AUDIENCE_LIGHTS] = BRIGHTNESS_OFF,
-    [WASH_LIGHTS] = COLOR_OFF,
-    [STAGE_EDGE_BARS] = COLOR_OFF,
-    [STAGE_CENTER_BARS] = COLOR_OFF,
-  },
-  // Scene 51:
-  [51] = {
-    [STAGE_SPOTS] = BRIGHTNESS_OFF,
-    [AUDIENCE_LIGHTS] = BRIGHTNESS_OFF,
-    [WASH_LIGHTS] = COLOR_OFF,
-    [STAGE_EDGE_BARS] = COLOR_OFF,
-    [STAGE_CENTER_BARS] = COLOR_OFF,
-  },
-  // Scene 52:
-  [52] = {
-    [STAGE_SPOTS] = BRIGHTNESS_OFF,
-    [AUDIENCE_LIGHTS] = BRIGHTNESS_OFF,
-    [WASH_LIGHTS] = COLOR_OFF,
-    [STAGE_EDGE_BARS] = COLOR_OFF,
-    [STAGE_CENTER_BARS] = COLOR_OFF,
-  },
-  // Scene 53:
-  [53] = {
-    [STAGE_SPOTS] = BRIGHTNESS_OFF,
-    [AUDIENCE_LIGHTS] = BRIGHTNESS_OFF,
-    [WASH_LIGHTS] = COLOR_OFF,
-    [STAGE_EDGE_BARS] = COLOR_OFF,
-    [STAGE_CENTER_BARS] = COLOR_OFF,
-  },
-  // Scene 54:
-  [54] = {
-    [STAGE_SPOTS] = BRIGHTNESS_OFF,
-    [AUDIENCE_LIGHTS] = BRIGHTNESS_OFF,
-    [WASH_LIGHTS] = COLOR_OFF,
-    [STAGE_EDGE_BARS] = COLOR_OFF,
-    [STAGE_CENTER_BARS] = COLOR_OFF,
-  },
-  // Scene 55:
-  [55] = {
-    [STAGE_SPOTS] = BRIGHTNESS_OFF,
-    [AUDIENCE_LIGHTS] = BRIGHTNESS_OFF,
-    [WASH_LIGHTS] = COLOR_OFF,
-    [STAGE_EDGE_BARS] = COLOR_OFF,
-    [STAGE_CENTER_BARS] = COLOR_OFF,
-  },
-  // Scene 56:
-  [56] = {
-    [STAGE_SPOTS] = BRIGHTNESS_OFF,
-    [AUDIENCE_LIGHTS] = BRIGHTNESS_OFF,
-    [WASH_LIGHTS] = COLOR_OFF,
-    [STAGE_EDGE_BARS] = COLOR_OFF,
-    [STAGE_CENTER_BARS] = COLOR_OFF,
-  },
-  // Scene 57:
-  [57] = {
-    [STAGE_SPOTS] = BRIGHTNESS_OFF,
-    [AUDIENCE_LIGHTS] = BRIGHTNESS_OFF,
-    [WASH_LIGHTS] = COLOR_OFF,
-    [STAGE_EDGE_BARS] = COLOR_OFF,
-    [STAGE_CENTER_BARS] = COLOR_OFF,
-  },
-  // Scene 58:
-  [58] = {
-    [STAGE_SPOTS] = BRIGHTNESS_OFF,
-    [AUDIENCE_LIGHTS] = BRIGHTNESS_OFF,
-    [WASH_LIGHTS] = COLOR_OFF,
-    [STAGE_EDGE_BARS] = COLOR_OFF,
-    [STAGE_CENTER_BARS] = COLOR_OFF,
-  },
-  // Scene 59:
-  [59] = {
-    [STAGE_SPOTS] = BRIGHTNESS_OFF,
-    [AUDIENCE_LIGHTS] = BRIGHTNESS_OFF,
-    [WASH_LIGHTS] = COLOR_OFF,
-    [STAGE_EDGE_BARS] = COLOR_OFF,
-    [STAGE_CENTER_BARS] = COLOR_OFF,
-  },
-  // Scene 60:
-  [60] = {
-    [STAGE_SPOTS] = BRIGHTNESS_OFF,
-    [AUDIENCE_LIGHTS] = BRIGHTNESS_OFF,
-    [WASH_LIGHTS] = COLOR_OFF,
-    [STAGE_EDGE_BARS] = COLOR_OFF,
-    [STAGE_CENTER_BARS] = COLOR_OFF,
-  },
-  // Scene 61:
-  [61] = {
-    [STAGE_SPOTS] = BRIGHTNESS_OFF,
-    [AUDIENCE_LIGHTS] = BRIGHTNESS_OFF,
-    [WASH_LIGHTS] = COLOR_OFF,
-    [STAGE_EDGE_BARS] = COLOR_OFF,
-    [STAGE_CENTER_BARS] = COLOR_OFF,
-  },
-  // Scene 62:
-  [62] = {
-    [STAGE_SPOTS] = BRIGHTNESS_OFF,
-    [AUDIENCE_LIGHTS] = BRIGHTNESS_OFF,
-    [WASH_LIGHTS] = COLOR_OFF,
-    [STAGE_EDGE_BARS] = COLOR_OFF,
-    [STAGE_CENTER_BARS] = COLOR_OFF,
-  },
-  // Scene 63:
-  [63] = {
-    [STAGE_SPOTS] = BRIGHTNESS_OFF,
-    [AUDIENCE_LIGHTS] = BRIGHTNESS_OFF,
-    [WASH_LIGHTS] = COLOR_OFF,
-    [STAGE_EDGE_BARS] = COLOR_OFF,
-    [STAGE_CENTER_BARS] = COLOR_OFF,
-  },
-  // Scene 64:
-  [64] = {
-    [STAGE_SPOTS] = BRIGHTNESS_OFF,
-    [AUDIENCE_LIGHTS] = BRIGHTNESS_OFF,
-    [WASH_LIGHTS] = COLOR_OFF,
-    [STAGE_EDGE_BARS] = COLOR_OFF,
-    [STAGE_CENTER_BARS] = COLOR_OFF,
-  },
-  // Scene 65:
-  [65] = {
-    [STAGE_SPOTS] = BRIGHTNESS_OFF,
-    [AUDIENCE_LIGHTS] = BRIGHTNESS_OFF,
-    [WASH_LIGHTS] = COLOR_OFF,
-    [STAGE_EDGE_BARS] = COLOR_OFF,
-    [STAGE_CENTER_BARS] = COLOR_OFF,
-  },
-  // Scene 66:
-  [66] = {
-    [STAGE_SPOTS] = BRIGHTNESS_OFF,
-    [AUDIENCE_LIGHTS] = BRIGHTNESS_OFF,
-    [WASH_LIGHTS] = COLOR_OFF,
-    [STAGE_EDGE_BARS] = COLOR_OFF,
-    [STAGE_CENTER_BARS] = COLOR_OFF,
-  },
-  // Scene 67:
-  [67] = {
-    [STAGE_SPOTS] = BRIGHTNESS_OFF,
-    [AUDIENCE_LIGHTS] = BRIGHTNESS_OFF,
-    [WASH_LIGHTS] = COLOR_OFF,
-    [STAGE_EDGE_BARS] = COLOR_OFF,
-    [STAGE_CENTER_BARS] = COLOR_OFF,
-  },
-  // Scene 68:
-  [68] = {
-    [STAGE_SPOTS] = BRIGHTNESS_OFF,
-    [AUDIENCE_LIGHTS] = BRIGHTNESS_OFF,
-    [WASH_LIGHTS] = COLOR_OFF,
-    [STAGE_EDGE_BARS] = COLOR_OFF,
-    [STAGE_CENTER_BARS] = COLOR_OFF,
-  },
-  // Scene 69:
-  [69] = {
-    [STAGE_SPOTS] = BRIGHTNESS_OFF,
-    [AUDIENCE_LIGHTS] = BRIGHTNESS_OFF,
-    [WASH_LIGHTS] = COLOR_OFF,
-    [STAGE_EDGE_BARS] = COLOR_OFF,
-    [STAGE_CENTER_BARS] = COLOR_OFF,
-  },
-  // Scene 70:
-  [70] = {
-    [STAGE_SPOTS] = BRIGHTNESS_OFF,
-    [AUDIENCE_LIGHTS] = BRIGHTNESS_OFF,
-    [WASH_LIGHTS] = COLOR_OFF,
-    [STAGE_EDGE_BARS] = COLOR_OFF,
-    [STAGE_CENTER_BARS] = COLOR_OFF,
-  },
-  // Scene 71:
-  [71] = {
-    [STAGE_SPOTS] = BRIGHTNESS_OFF,
-    [AUDIENCE_LIGHTS] = BRIGHTNESS_OFF,
-    [WASH_LIGHTS] = COLOR_OFF,
-    [STAGE_EDGE_BARS] = COLOR_OFF,
-    [STAGE_CENTER_BARS] = COLOR_OFF,
-  },
-  // Scene 72:
-  [72] = {
-    [STAGE_SPOTS] = BRIGHTNESS_OFF,
-    [AUDIENCE_LIGHTS] = BRIGHTNESS_OFF,
-    [WASH_LIGHTS] = COLOR_OFF,
-    [STAGE_EDGE_BARS] = COLOR_OFF,
-    [STAGE_CENTER_BARS] = COLOR_OFF,
-  },
-  // Scene 73:
-  [73] = {
-    [STAGE_SPOTS] = BRIGHTNESS_OFF,
-    [AUDIENCE_LIGHTS] = BRIGHTNESS_OFF,
-    [WASH_LIGHTS] = COLOR_OFF,
-    [STAGE_EDGE_BARS] = COLOR_OFF,
-    [STAGE_CENTER_BARS] = COLOR_OFF,
-  },
-  // Scene 74:
-  [74] = {
-    [STAGE_SPOTS] = BRIGHTNESS_OFF,
-    [AUDIENCE_LIGHTS] = BRIGHTNESS_OFF,
-    [WASH_LIGHTS] = COLOR_OFF,
-    [STAGE_EDGE_BARS] = COLOR_OFF,
-    [STAGE_CENTER_BARS] = COLOR_OFF,
-  },
-  // Scene 75:
-  [75] = {
-    [STAGE_SPOTS] = BRIGHTNESS_OFF,
-    [AUDIENCE_LIGHTS] = BRIGHTNESS_OFF,
-    [WASH_LIGHTS] = COLOR_OFF,
-    [STAGE_EDGE_BARS] = COLOR_OFF,
-    [STAGE_CENTER_BARS] = COLOR_OFF,
-  },
-  // Scene 76:
-  [76] = {
-    [STAGE_SPOTS] = BRIGHTNESS_OFF,
-    [AUDIENCE_LIGHTS] = BRIGHTNESS_OFF,
-    [WASH_LIGHTS] = COLOR_OFF,
-    [STAGE_EDGE_BARS] = COLOR_OFF,
-    [STAGE_CENTER_BARS] = COLOR_OFF,
-  },
-  // Scene 77:
-  [77] = {
-    [STAGE_SPOTS] = BRIGHTNESS_OFF,
-    [AUDIENCE_LIGHTS] = BRIGHTNESS_OFF,
-    [WASH_LIGHTS] = COLOR_OFF,
-    [STAGE_EDGE_BARS] = COLOR_OFF,
-    [STAGE_CENTER_BARS] = COLOR_OFF,
-  },
-  // Scene 78:
-  [78] = {
-    [STAGE_SPOTS] = BRIGHTNESS_OFF,
-    [AUDIENCE_LIGHTS] = BRIGHTNESS_OFF,
-    [WASH_LIGHTS] = COLOR_OFF,
-    [STAGE_EDGE_BARS] = COLOR_OFF,
-    [STAGE_CENTER_BARS] = COLOR_OFF,
-  },
-  // Scene 79:
-  [79] = {
-    [STAGE_SPOTS] = BRIGHTNESS_OFF,
-    [AUDIENCE_LIGHTS] = BRIGHTNESS_OFF,
-    [WASH_LIGHTS] = COLOR_OFF,
-    [STAGE_EDGE_BARS] = COLOR_OFF,
-    [STAGE_CENTER_BARS] = COLOR_OFF,
-  },
-  // Scene 80:
-  [80] = {
-    [STAGE_SPOTS] = BRIGHTNESS_OFF,
-    [AUDIENCE_LIGHTS] = BRIGHTNESS_OFF,
-    [WASH_LIGHTS] = COLOR_OFF,
-    [STAGE_EDGE_BARS] = COLOR_OFF,
-    [STAGE_CENTER_BARS] = COLOR_OFF,
-  },
-  // Scene 81:
-  [81] = {
-    [STAGE_SPOTS] = BRIGHTNESS_OFF,
-    [AUDIENCE_LIGHTS] = BRIGHTNESS_OFF,
-    [WASH_LIGHTS] = COLOR_OFF,
-    [STAGE_EDGE_BARS] = COLOR_OFF,
-    [STAGE_CENTER_BARS] = COLOR_OFF,
-  },
-  // Scene 82:
-  [82] = {
-    [STAGE_SPOTS] = BRIGHTNESS_OFF,
-    [AUDIENCE_LIGHTS] = BRIGHTNESS_OFF,
-    [WASH_LIGHTS] = COLOR_OFF,
-    [STAGE_EDGE_BARS] = COLOR_OFF,
-    [STAGE_CENTER_BARS] = COLOR_OFF,
-  },
-  // Scene 83:
-  [83] = {
-    [STAGE_SPOTS] = BRIGHTNESS_OFF,
-    [AUDIENCE_LIGHTS] = BRIGHTNESS_OFF,
-    [WASH_LIGHTS] = COLOR_OFF,
-    [STAGE_EDGE_BARS] = COLOR_OFF,
-    [STAGE_CENTER_BARS] = COLOR_OFF,
-  },
-  // Scene 84:
-  [84] = {
-    [STAGE_SPOTS] = BRIGHTNESS_OFF,
-    [AUDIENCE_LIGHTS] = BRIGHTNESS_OFF,
-    [WASH_LIGHTS] = COLOR_OFF,
-    [STAGE_EDGE_BARS] = COLOR_OFF,
-    [STAGE_CENTER_BARS] = COLOR_OFF,
-  },
-  // Scene 85:
-  [85] = {
-    [STAGE_SPOTS] = BRIGHTNESS_OFF,
-    [AUDIENCE_LIGHTS] = BRIGHTNESS_OFF,
-    [WASH_LIGHTS] = COLOR_OFF,
-    [STAGE_EDGE_BARS] = COLOR_OFF,
-    [STAGE_CENTER_BARS] = COLOR_OFF,
-  },
-  // Scene 86:
-  [86] = {
-    [STAGE_SPOTS] = BRIGHTNESS_OFF,
-    [AUDIENCE_LIGHTS] = BRIGHTNESS_OFF,
-    [WASH_LIGHTS] = COLOR_OFF,
-    [STAGE_EDGE_BARS] = COLOR_OFF,
-    [STAGE_CENTER_BARS] = COLOR_OFF,
-  },
-  // Scene 87:
-  [87] = {
-    [STAGE_SPOTS] = BRIGHTNESS_OFF,
-    [AUDIENCE_LIGHTS] = BRIGHTNESS_OFF,
-    [WASH_LIGHTS] = COLOR_OFF,
-    [STAGE_EDGE_BARS] = COLOR_OFF,
-    [STAGE_CENTER_BARS] = COLOR_OFF,
-  },
-  // Scene 88:
-  [88] = {
-    [STAGE_SPOTS] = BRIGHTNESS_OFF,
-    [AUDIENCE_LIGHTS] = BRIGHTNESS_OFF,
-    [WASH_LIGHTS] = COLOR_OFF,
-    [STAGE_EDGE_BARS] = COLOR_OFF,
-    [STAGE_CENTER_BARS] = COLOR_OFF,
-  },
-  // Scene 89:
-  [89] = {
-    [STAGE_SPOTS] = BRIGHTNESS_OFF,
-    [AUDIENCE_LIGHTS] = BRIGHTNESS_OFF,
-    [WASH_LIGHTS] = COLOR_OFF,
-    [STAGE_EDGE_BARS] = COLOR_OFF,
-    [STAGE_CENTER_BARS] = COLOR_OFF,
-  },
-  // Scene 90:
-  [90] = {
-    [STAGE_SPOTS] = BRIGHTNESS_OFF,
-    [AUDIENCE_LIGHTS] = BRIGHTNESS_OFF,
-    [WASH_LIGHTS] = COLOR_OFF,
-    [STAGE_EDGE_BARS] = COLOR_OFF,
-    [STAGE_CENTER_BARS] = COLOR_OFF,
-  },
-  // Scene 91:
-  [91] = {
-    [STAGE_SPOTS] = BRIGHTNESS_OFF,
-    [AUDIENCE_LIGHTS] = BRIGHTNESS_OFF,
-    [WASH_LIGHTS] = COLOR_OFF,
-    [STAGE_EDGE_BARS] = COLOR_OFF,
-    [STAGE_CENTER_BARS] = COLOR_OFF,
-  },
-  // Scene 92:
-  [92] = {
-    [STAGE_SPOTS] = BRIGHTNESS_OFF,
-    [AUDIENCE_LIGHTS] = BRIGHTNESS_OFF,
-    [WASH_LIGHTS] = COLOR_OFF,
-    [STAGE_EDGE_BARS] = COLOR_OFF,
-    [STAGE_CENTER_BARS] = COLOR_OFF,
-  },
-  // Scene 93:
-  [93] = {
-    [STAGE_SPOTS] = BRIGHTNESS_OFF,
-    [AUDIENCE_LIGHTS] = BRIGHTNESS_OFF,
-    [WASH_LIGHTS] = COLOR_OFF,
-    [STAGE_EDGE_BARS] = COLOR_OFF,
-    [STAGE_CENTER_BARS] = COLOR_OFF,
-  },
-  // Scene 94:
-  [94] = {
-    [STAGE_SPOTS] = BRIGHTNESS_OFF,
-    [AUDIENCE_LIGHTS] = BRIGHTNESS_OFF,
-    [WASH_LIGHTS] = COLOR_OFF,
-    [STAGE_EDGE_BARS] = COLOR_OFF,
-    [STAGE_CENTER_BARS] = COLOR_OFF,
-  },
-  // Scene 95:
-  [95] = {
-    [STAGE_SPOTS] = BRIGHTNESS_OFF,
-    [AUDIENCE_LIGHTS] = BRIGHTNESS_OFF,
-    [WASH_LIGHTS] = COLOR_OFF,
-    [STAGE_EDGE_BARS] = COLOR_OFF,
-    [STAGE_CENTER_BARS] = COLOR_OFF,
-  },
-  // Scene 96:
-  [96] = {
-    [STAGE_SPOTS] = BRIGHTNESS_OFF,
-    [AUDIENCE_LIGHTS] = BRIGHTNESS_OFF,
-    [WASH_LIGHTS] = COLOR_OFF,
-    [STAGE_EDGE_BARS] = COLOR_OFF,
-    [STAGE_CENTER_BARS] = COLOR_OFF,
-  },
-  // Scene 97:
-  [97] = {
-    [STAGE_SPOTS] = BRIGHTNESS_OFF,
-    [AUDIENCE_LIGHTS] = BRIGHTNESS_OFF,
-    [WASH_LIGHTS] = COLOR_OFF,
-    [STAGE_EDGE_BARS] = COLOR_OFF,
-    [STAGE_CENTER_BARS] = COLOR_OFF,
-  },
-  // Scene 98:
-  [98] = {
-    [STAGE_SPOTS] = BRIGHTNESS_OFF,
-    [AUDIENCE_LIGHTS] = BRIGHTNESS_OFF,
-    [WASH_LIGHTS] = COLOR_OFF,
-    [STAGE_EDGE_BARS] = COLOR_OFF,
-    [STAGE_CENTER_BARS] = COLOR_OFF,
-  },
-  // Scene 99:
-  [99] = {
-    [STAGE_SPOTS] = BRIGHTNESS_OFF,
-    [AUDIENCE_LIGHTS] = BRIGHTNESS_OFF,
-    [WASH_LIGHTS] = COLOR_OFF,
-    [STAGE_EDGE_BARS] = COLOR_OFF,
-    [STAGE_CENTER_BARS] = COLOR_OFF,
-  },
   /*
-   * Scenes 100-110 are Good Friday scenes.
+   * Rows 43-53 are the Good Friday scenes, 100-110.
    * 
    * Red side lighting, red stage lighting, fading overheads/spots.
    * 
@@ -964,228 +530,115 @@ const PROGMEM byte scenes[MAX_SCENE_COUNT][MAX_UNIQUE_CHANNELS] = {
    * 
    * Overheads start with the music scene layout and fade.
    */
-  // Scene 100:
-  [100] = {
+  // Row 43: Scene 100
+  [43] = {
     [STAGE_SPOTS] = DIM(BRIGHTNESS_HIGH, 0),
     [AUDIENCE_LIGHTS] = DIM(BRIGHTNESS_MED, 0),
     [WASH_LIGHTS] = COLOR_OFF,
     [STAGE_EDGE_BARS] = COLOR_OFF,
     [STAGE_CENTER_BARS] = COLOR_OFF,
   },
-  // Scene 101:
-  [101] = {
+  // Row 44: Scene 101
+  [44] = {
     [STAGE_SPOTS] = DIM(BRIGHTNESS_HIGH, 10),
     [AUDIENCE_LIGHTS] = DIM(BRIGHTNESS_MED, 10),
     [WASH_LIGHTS] = COLOR_RED,
     [STAGE_EDGE_BARS] = COLOR_RED,
     [STAGE_CENTER_BARS] = COLOR_RED,
   },
-  // Scene 102:
-  [102] = {
+  // Row 45: Scene 102
+  [45] = {
     [STAGE_SPOTS] = DIM(BRIGHTNESS_HIGH, 20),
     [AUDIENCE_LIGHTS] = DIM(BRIGHTNESS_MED, 20),
     [WASH_LIGHTS] = COLOR_RED,
     [STAGE_EDGE_BARS] = COLOR_RED,
     [STAGE_CENTER_BARS] = COLOR_RED,
   },
-  // Scene 103:
-  [103] = {
+  // Row 46: Scene 103
+  [46] = {
     [STAGE_SPOTS] = DIM(BRIGHTNESS_HIGH, 30),
     [AUDIENCE_LIGHTS] = DIM(BRIGHTNESS_MED, 30),
     [WASH_LIGHTS] = COLOR_RED,
     [STAGE_EDGE_BARS] = COLOR_RED,
     [STAGE_CENTER_BARS] = COLOR_RED,
   },
-  // Scene 104:
-  [104] = {
+  // Row 47: Scene 104
+  [47] = {
     [STAGE_SPOTS] = DIM(BRIGHTNESS_HIGH, 40),
     [AUDIENCE_LIGHTS] = DIM(BRIGHTNESS_MED, 40),
     [WASH_LIGHTS] = COLOR_RED,
     [STAGE_EDGE_BARS] = COLOR_RED,
     [STAGE_CENTER_BARS] = COLOR_RED,
   },
-  // Scene 105:
-  [105] = {
+  // Row 48: Scene 105
+  [48] = {
     [STAGE_SPOTS] = DIM(BRIGHTNESS_HIGH, 50),
     [AUDIENCE_LIGHTS] = DIM(BRIGHTNESS_MED, 50),
     [WASH_LIGHTS] = COLOR_RED,
     [STAGE_EDGE_BARS] = COLOR_RED,
     [STAGE_CENTER_BARS] = COLOR_RED,
   },
-  // Scene 106:
-  [106] = {
+  // Row 49: Scene 106
+  [49] = {
     [STAGE_SPOTS] = DIM(BRIGHTNESS_HIGH, 60),
     [AUDIENCE_LIGHTS] = DIM(BRIGHTNESS_MED, 60),
     [WASH_LIGHTS] = COLOR_RED,
     [STAGE_EDGE_BARS] = COLOR_RED,
     [STAGE_CENTER_BARS] = COLOR_RED,
   },
-  // Scene 107:
-  [107] = {
+  // Row 50: Scene 107
+  [50] = {
     [STAGE_SPOTS] = DIM(BRIGHTNESS_HIGH, 70),
     [AUDIENCE_LIGHTS] = DIM(BRIGHTNESS_MED, 70),
     [WASH_LIGHTS] = COLOR_RED,
     [STAGE_EDGE_BARS] = COLOR_RED,
     [STAGE_CENTER_BARS] = COLOR_RED,
   },
-  // Scene 108:
-  [108] = {
+  // Row 51: Scene 108
+  [51] = {
     [STAGE_SPOTS] = DIM(BRIGHTNESS_HIGH, 80),
     [AUDIENCE_LIGHTS] = DIM(BRIGHTNESS_MED, 80),
     [WASH_LIGHTS] = COLOR_RED,
     [STAGE_EDGE_BARS] = COLOR_RED,
     [STAGE_CENTER_BARS] = COLOR_RED,
   },
-  // Scene 109:
-  [109] = {
+  // Row 52: Scene 109
+  [52] = {
     [STAGE_SPOTS] = 100, //DIM(BRIGHTNESS_HIGH, 90),
     [AUDIENCE_LIGHTS] = 100, //DIM(BRIGHTNESS_MED, 90),
     [WASH_LIGHTS] = COLOR_RED,
     [STAGE_EDGE_BARS] = COLOR_RED,
     [STAGE_CENTER_BARS] = COLOR_RED,
   },
-  // Scene 110:
-  [110] = {
+  // Row 53: Scene 110
+  [53] = {
     [STAGE_SPOTS] = DIM(BRIGHTNESS_HIGH, 100),
     [AUDIENCE_LIGHTS] = DIM(BRIGHTNESS_MED, 100),
     [WASH_LIGHTS] = COLOR_RED,
     [STAGE_EDGE_BARS] = COLOR_RED,
     [STAGE_CENTER_BARS] = COLOR_RED,
   },
-  // Scene 111:
-  [111] = {
-    [STAGE_SPOTS] = BRIGHTNESS_OFF,
-    [AUDIENCE_LIGHTS] = BRIGHTNESS_OFF,
-    [WASH_LIGHTS] = COLOR_OFF,
-    [STAGE_EDGE_BARS] = COLOR_OFF,
-    [STAGE_CENTER_BARS] = COLOR_OFF,
-  },
-  // Scene 112:
-  [112] = {
-    [STAGE_SPOTS] = BRIGHTNESS_OFF,
-    [AUDIENCE_LIGHTS] = BRIGHTNESS_OFF,
-    [WASH_LIGHTS] = COLOR_OFF,
-    [STAGE_EDGE_BARS] = COLOR_OFF,
-    [STAGE_CENTER_BARS] = COLOR_OFF,
-  },
-  // Scene 113:
-  [113] = {
-    [STAGE_SPOTS] = BRIGHTNESS_OFF,
-    [AUDIENCE_LIGHTS] = BRIGHTNESS_OFF,
-    [WASH_LIGHTS] = COLOR_OFF,
-    [STAGE_EDGE_BARS] = COLOR_OFF,
-    [STAGE_CENTER_BARS] = COLOR_OFF,
-  },
-  // Scene 114:
-  [114] = {
-    [STAGE_SPOTS] = BRIGHTNESS_OFF,
-    [AUDIENCE_LIGHTS] = BRIGHTNESS_OFF,
-    [WASH_LIGHTS] = COLOR_OFF,
-    [STAGE_EDGE_BARS] = COLOR_OFF,
-    [STAGE_CENTER_BARS] = COLOR_OFF,
-  },
-  // Scene 115:
-  [115] = {
-    [STAGE_SPOTS] = BRIGHTNESS_OFF,
-    [AUDIENCE_LIGHTS] = BRIGHTNESS_OFF,
-    [WASH_LIGHTS] = COLOR_OFF,
-    [STAGE_EDGE_BARS] = COLOR_OFF,
-    [STAGE_CENTER_BARS] = COLOR_OFF,
-  },
-  // Scene 116:
-  [116] = {
-    [STAGE_SPOTS] = BRIGHTNESS_OFF,
-    [AUDIENCE_LIGHTS] = BRIGHTNESS_OFF,
-    [WASH_LIGHTS] = COLOR_OFF,
-    [STAGE_EDGE_BARS] = COLOR_OFF,
-    [STAGE_CENTER_BARS] = COLOR_OFF,
-  },
-  // Scene 117:
-  [117] = {
-    [STAGE_SPOTS] = BRIGHTNESS_OFF,
-    [AUDIENCE_LIGHTS] = BRIGHTNESS_OFF,
-    [WASH_LIGHTS] = COLOR_OFF,
-    [STAGE_EDGE_BARS] = COLOR_OFF,
-    [STAGE_CENTER_BARS] = COLOR_OFF,
-  },
-  // Scene 118:
-  [118] = {
-    [STAGE_SPOTS] = BRIGHTNESS_OFF,
-    [AUDIENCE_LIGHTS] = BRIGHTNESS_OFF,
-    [WASH_LIGHTS] = COLOR_OFF,
-    [STAGE_EDGE_BARS] = COLOR_OFF,
-    [STAGE_CENTER_BARS] = COLOR_OFF,
-  },
-  // Scene 119:
-  [119] = {
-    [STAGE_SPOTS] = BRIGHTNESS_OFF,
-    [AUDIENCE_LIGHTS] = BRIGHTNESS_OFF,
-    [WASH_LIGHTS] = COLOR_OFF,
-    [STAGE_EDGE_BARS] = COLOR_OFF,
-    [STAGE_CENTER_BARS] = COLOR_OFF,
-  },
-  // Scene 120:
-  [120] = {
-    [STAGE_SPOTS] = BRIGHTNESS_OFF,
-    [AUDIENCE_LIGHTS] = BRIGHTNESS_OFF,
-    [WASH_LIGHTS] = COLOR_OFF,
-    [STAGE_EDGE_BARS] = COLOR_OFF,
-    [STAGE_CENTER_BARS] = COLOR_OFF,
-  },
-  // Scene 121:
-  [121] = {
-    [STAGE_SPOTS] = BRIGHTNESS_OFF,
-    [AUDIENCE_LIGHTS] = BRIGHTNESS_OFF,
-    [WASH_LIGHTS] = COLOR_OFF,
-    [STAGE_EDGE_BARS] = COLOR_OFF,
-    [STAGE_CENTER_BARS] = COLOR_OFF,
-  },
-  // Scene 122:
-  [122] = {
-    [STAGE_SPOTS] = BRIGHTNESS_OFF,
-    [AUDIENCE_LIGHTS] = BRIGHTNESS_OFF,
-    [WASH_LIGHTS] = COLOR_OFF,
-    [STAGE_EDGE_BARS] = COLOR_OFF,
-    [STAGE_CENTER_BARS] = COLOR_OFF,
-  },
-  // Scene 123:
-  [123] = {
-    [STAGE_SPOTS] = BRIGHTNESS_OFF,
-    [AUDIENCE_LIGHTS] = BRIGHTNESS_OFF,
-    [WASH_LIGHTS] = COLOR_OFF,
-    [STAGE_EDGE_BARS] = COLOR_OFF,
-    [STAGE_CENTER_BARS] = COLOR_OFF,
-  },
-  // Scene 124:
-  [124] = {
-    [STAGE_SPOTS] = BRIGHTNESS_OFF,
-    [AUDIENCE_LIGHTS] = BRIGHTNESS_OFF,
-    [WASH_LIGHTS] = COLOR_OFF,
-    [STAGE_EDGE_BARS] = COLOR_OFF,
-    [STAGE_CENTER_BARS] = COLOR_OFF,
-  },
-  // Scene 125:
-  [125] = {
-    [STAGE_SPOTS] = BRIGHTNESS_OFF,
-    [AUDIENCE_LIGHTS] = BRIGHTNESS_OFF,
-    [WASH_LIGHTS] = COLOR_OFF,
-    [STAGE_EDGE_BARS] = COLOR_OFF,
-    [STAGE_CENTER_BARS] = COLOR_OFF,
-  },
-  // Scene 126:
-  [126] = {
-    [STAGE_SPOTS] = BRIGHTNESS_OFF,
-    [AUDIENCE_LIGHTS] = BRIGHTNESS_OFF,
-    [WASH_LIGHTS] = COLOR_OFF,
-    [STAGE_EDGE_BARS] = COLOR_OFF,
-    [STAGE_CENTER_BARS] = COLOR_OFF,
-  },
-  // Scene 127:
-  [127] = {
-    [STAGE_SPOTS] = BRIGHTNESS_OFF,
-    [AUDIENCE_LIGHTS] = BRIGHTNESS_OFF,
-    [WASH_LIGHTS] = COLOR_OFF,
-    [STAGE_EDGE_BARS] = COLOR_OFF,
-    [STAGE_CENTER_BARS] = COLOR_OFF,
-  },
+};
+
+#define SCENE_ROW_COUNT (sizeof(scene_rows) / MAX_UNIQUE_CHANNELS)
+
+/**
+ * Which row of scene_rows each scene (MIDI note) uses.  This is in scene order,
+ * ten scenes per line.  Any scenes at the end that aren't listed use row 0 and
+ * are all off, so there's no need to list them out.  The build checks that
+ * every row listed here exists.
+ */
+constexpr PROGMEM byte scene_index[MAX_SCENE_COUNT] = {
+   0,  1,  2,  3,  4,  5,  6,  7,  8,  9, //   0-9: Off, Preservice 1-9
+  10, 11, 12, 13, 14, 15, 16, 17, 18, 19, // 10-19: Preservice 10-16, Music 1-3
+  20, 21, 22, 23, 24, 25, 26, 27, 28, 29, // 20-29: Music 4-13
+  30, 31, 32, 33, 34, 35, 36, 37, 38, 39, // 30-39: Music 14-16, Sermon 1-7
+  40, 41, 42, 42, 42, 42, 42, 42, 42,  0, // 40-49: Sermon 8-16, Off
+   0,  0,  0,  0,  0,  0,  0,  0,  0,  0, // 50-59: Off
+   0,  0,  0,  0,  0,  0,  0,  0,  0,  0, // 60-69: Off
+   0,  0,  0,  0,  0,  0,  0,  0,  0,  0, // 70-79: Off
+   0,  0,  0,  0,  0,  0,  0,  0,  0,  0, // 80-89: Off
+   0,  0,  0,  0,  0,  0,  0,  0,  0,  0, // 90-99: Off
+  43, 44, 45, 46, 47, 48, 49, 50, 51, 52, // 100-109: Good Friday 0-90%
+  53,                                     // 110: Good Friday 100%
 };
@@ -1,80 +1,823 @@
-// If this is defined, will build as USB MIDI for the 32U4 based units.
-// Else, will build as serial MIDI (for prototype units)
+// Define this to take MIDI from USB, on the 32U4 based units.
 #define USE_USB_MIDI
 
+// Define this to take MIDI from the hardware serial port (the DIN socket on
+// the booth units, and the only input on the prototype units).  With both
+// defined, commands from either one are run as they come in.
+#define USE_SERIAL_MIDI
+
+// Define this to send DMX out of the hardware UART (the TX pin), instead of
+// bit-banging it out of pin 3 with DmxMaster.  This frees up most of the CPU
+// time DmxMaster uses.  Only for the 32U4 based units.  See dmx_uart.h.
+//#define DMX_OUTPUT_UART
+
+// Define this to wait this many milliseconds at power up before doing anything,
+// to avoid the "double start" issues on older boards.  The current units don't
+// need it, and the lights get no DMX until it's over, so leave it off unless
+// the board does.
+//#define BOOT_DELAY_MILLIS 2000
+
 // Define this to print out state to serial.  Useful for debugging.
 // Leave this off in production.  This ONLY WORKS ON THE PRO MINI.
 //#define PRINT_STATE
 
-#include <EEPROM.h>
+// Define this to use the fast fade time encoding, where the fade time sent in
+// each command covers everything from a 100ms bump up to a bit over 3 minutes.
+// Else, fade times are in whole seconds.  See get_fade_millis() for the values.
+//#define FAST_FADE_TIMES
 
-// REQUIRES LIBRARY:
-// https://github.com/TinkerKit/DmxMaster
-#include <DmxMaster.h>
+// Define this to keep performance counters, which can be read out over USB MIDI
+// with a SysEx request.  See send_perf_counters_part() for the details.
+#define PERF_COUNTERS
 
-#ifdef USE_USB_MIDI
-// REQUIRES LIBRARY:
-// https://github.com/arduino-libraries/MIDIUSB
-#include <MIDIUSB.h>
+// Define this to keep a record of the last few MIDI commands received, and when
+// their fades started, which can be read out over USB MIDI with a SysEx
+// request.  See send_midi_capture_part() for the details.
+#define MIDI_CAPTURE
+
+// Define this to be able to stream the channel values, fade progress, and
+// EEPROM state back over USB MIDI as they change, for a live view on the host.
+// The host turns the stream on with a SysEx request.  See send_telemetry() for
+// the details.
+#define TELEMETRY
+
+// Define this to run the fades from an incoming MIDI clock, so several
+// converters fed the same clock start and finish their fades together.  See
+// get_fade_clock() for how it works.
+//#define SYNC_MIDI_CLOCK
+
+// Define this (with SYNC_MIDI_CLOCK) to make this converter the sync master:
+// it makes the MIDI clock itself, and sends it out of the TX pin to the serial
+// MIDI inputs of the others.
+//#define SYNC_MASTER
+
+// Without USB MIDI there's no way to send anything back, so the serial only
+// units never keep the counters, the capture, or the telemetry.
+#ifndef USE_USB_MIDI
+#undef PERF_COUNTERS
+#undef MIDI_CAPTURE
+#undef TELEMETRY
+#endif
+
+#if defined(PERF_COUNTERS) || defined(MIDI_CAPTURE) || defined(TELEMETRY)
+#define USE_SYSEX
+#endif
+
+#if !defined(USE_USB_MIDI) && !defined(USE_SERIAL_MIDI)
+#error "At least one of USE_USB_MIDI and USE_SERIAL_MIDI must be defined"
+#endif
+
+// The UART can't send DMX and receive serial MIDI at the same time, as the two
+// need different baud rates.
+#if defined(DMX_OUTPUT_UART) && defined(USE_SERIAL_MIDI)
+#error "DMX_OUTPUT_UART can't be used with USE_SERIAL_MIDI"
+#endif
+
+#if defined(SYNC_MASTER) && \
+        (!defined(SYNC_MIDI_CLOCK) || !defined(USE_SERIAL_MIDI))
+#error "SYNC_MASTER needs SYNC_MIDI_CLOCK and USE_SERIAL_MIDI"
+#endif
+
+// The host build (see host/Makefile) swaps in stand-in hardware, to run the
+// lighting logic on a PC.
+#ifdef HOST_BUILD
+#include "host/hardware.h"
+#else
+#include "hardware.h"
 #endif
 
 #include "defines.h"
 #include "fixed_channels.h"
 #include "scenes.h"
+#include "chases.h"
 #include "fixtures.h"
+#include "fade_curves.h"
+#include "layers.h"
+#include "masters.h"
+
+// A full DMX universe.  DmxMaster only supports this many channels on the
+// bigger chips (like the 32U4) - the "small memory" devices only get 128.  The
+// UART output always supports all of them.
+#define MAX_DMX_CHANNELS 512
+
+// The highest DMX channel that can be used.  Every channel used in the headers
+// has to be in here, and it can go up to the size of the universe.  Only the
+// channels up to the highest one in use are actually sent out, so a small rig
+// gets a lot more frames a second.
+#define DMX_OUTPUT_CHANNELS 128
+
+// The fewest channels sent out in each DMX frame, however few are in use.
+// Some fixtures don't cope with frames that come too close together, and 24
+// keeps to the DMX minimum of about 1.2ms from one frame to the next.
+#define DMX_MIN_FRAME_CHANNELS 24
+
+// Raw DMX channel mode can set any channel from 1-127, not just the ones used
+// in the headers.  This many of those can be in use at once.
+#define RAW_CHANNEL_POOL_SIZE 16
+
+// DMX frame timing, used to run the fader once per frame sent out.  Each slot
+// is 11 bits at 4us, and each frame has the break, mark after break, and start
+// code on top of the channel slots.  The UART output counts its frames as they
+// finish, and the fader runs off that, but DmxMaster doesn't say when it has
+// finished a frame, so with that the fader is timed from this estimate instead.
+// See dmx_frame_due().
+#define DMX_SLOT_MICROS 44
+#define DMX_FRAME_OVERHEAD_MICROS 200
+#define DMX_FRAME_MICROS(channels) (DMX_FRAME_OVERHEAD_MICROS +                \
+        ((uint32_t)(channels) * DMX_SLOT_MICROS))
+
+/**
+ * Compile time checks of the lighting setup in the headers.  It's a lot nicer
+ * to have the build fail with a message saying what's wrong than to flash the
+ * converter and find out in the middle of a service.  These are all checked
+ * recursively, as that's all the Arduino C++ version allows in a constexpr.
+ * 
+ * As these are checked here, the code below doesn't need to check them again.
+ */
+constexpr bool is_valid_dmx_channel(const int channel) {
+  return channel > 0 && channel <= DMX_OUTPUT_CHANNELS;
+}
+
+constexpr bool scene_channel_is_unique(const byte slot, const byte other) {
+  return other >= MAX_UNIQUE_CHANNELS ||
+          (scene_slot_to_channel_mapping[slot] !=
+                  scene_slot_to_channel_mapping[other] &&
+          scene_channel_is_unique(slot, other + 1));
+}
+
+constexpr bool scene_slots_are_valid(const byte slot = 0) {
+  return slot >= MAX_UNIQUE_CHANNELS ||
+          (is_valid_dmx_channel(scene_slot_to_channel_mapping[slot]) &&
+          scene_channel_is_unique(slot, slot + 1) &&
+          scene_slots_are_valid(slot + 1));
+}
+
+constexpr bool scene_index_is_valid(const byte scene = 0) {
+  return scene >= MAX_SCENE_COUNT ||
+          (scene_index[scene] < SCENE_ROW_COUNT &&
+          scene_index_is_valid(scene + 1));
+}
+
+constexpr bool fixture_profile_is_valid(const fixture_profile profile,
+        const byte channel = 0) {
+  return channel >= profile.channel_count ||
+          (profile.layout[channel] < EMITTER_COUNT &&
+          (profile.layout[channel] != EMITTER_DIMMER_FINE ||
+                  (channel > 0 &&
+                  profile.layout[channel - 1] == EMITTER_DIMMER)) &&
+          fixture_profile_is_valid(profile, channel + 1));
+}
+
+constexpr bool fixture_profiles_are_valid(const byte type = 0) {
+  return type >= FIXTURE_TYPE_COUNT ||
+          (fixture_profiles[type].channel_count <= MAX_FIXTURE_CHANNELS &&
+          fixture_profile_is_valid(fixture_profiles[type]) &&
+          fixture_profiles_are_valid(type + 1));
+}
+
+constexpr byte get_fixture_channel_count(const fixture_data fixture) {
+  return fixture_profiles[FIXTURE_TYPE_INDEX(fixture.fixture_type)]
+          .channel_count;
+}
+
+constexpr byte get_fixture_emitter(const fixture_data fixture,
+        const byte channel) {
+  return fixture_profiles[FIXTURE_TYPE_INDEX(fixture.fixture_type)]
+          .layout[channel];
+}
+
+constexpr bool fixture_is_valid(const fixture_data fixture) {
+  return fixture.fixture_type == FIXTURE_UNUSED ||
+          (!(fixture.fixture_type & 0xf) &&
+          FIXTURE_TYPE_INDEX(fixture.fixture_type) < FIXTURE_TYPE_COUNT &&
+          is_valid_dmx_channel(fixture.fixture_base_address) &&
+          is_valid_dmx_channel(fixture.fixture_base_address +
+                  get_fixture_channel_count(fixture) - 1));
+}
+
+constexpr bool fixtures_are_valid(const byte fixture = 0) {
+  return fixture >= MAX_FIXTURE_COUNT ||
+          (fixture_is_valid(fixtures[fixture]) &&
+          fixtures_are_valid(fixture + 1));
+}
+
+/**
+ * The coarse and fine channels of a 16-bit dimmer have to belong to their
+ * fixture alone.  This way, they always get channel entries next to each other,
+ * and nothing sets one half without the fixture knowing about the other.
+ */
+constexpr bool scene_uses_channel(const uint16_t address,
+        const byte slot = 0) {
+  return slot < MAX_UNIQUE_CHANNELS &&
+          (scene_slot_to_channel_mapping[slot] == address ||
+          scene_uses_channel(address, slot + 1));
+}
+
+constexpr bool fixed_uses_channel(const uint16_t address, const byte i = 0) {
+  return i < NUMBER_OF_FIXED_CHANNELS &&
+          (fixed_channels[i].channel == address ||
+          fixed_uses_channel(address, i + 1));
+}
+
+constexpr bool htp_uses_channel(const uint16_t address, const byte i = 0) {
+  return i < HTP_CHANNEL_COUNT &&
+          (htp_channels[i] == address || htp_uses_channel(address, i + 1));
+}
+
+constexpr bool fixture_uses_channel(const fixture_data fixture,
+        const uint16_t address) {
+  return fixture.fixture_type != FIXTURE_UNUSED &&
+          address >= fixture.fixture_base_address &&
+          address < fixture.fixture_base_address +
+                  get_fixture_channel_count(fixture);
+}
+
+constexpr bool other_fixture_uses_channel(const uint16_t address,
+        const byte owner, const byte fixture = 0) {
+  return fixture < MAX_FIXTURE_COUNT &&
+          ((fixture != owner &&
+                  fixture_uses_channel(fixtures[fixture], address)) ||
+          other_fixture_uses_channel(address, owner, fixture + 1));
+}
+
+constexpr bool channel_is_fixture_only(const uint16_t address,
+        const byte fixture) {
+  return !scene_uses_channel(address) && !fixed_uses_channel(address) &&
+          !htp_uses_channel(address) &&
+          !other_fixture_uses_channel(address, fixture);
+}
+
+constexpr bool fixture_fine_channels_are_valid(const byte fixture,
+        const byte channel = 0) {
+  return channel >= get_fixture_channel_count(fixtures[fixture]) ||
+          ((get_fixture_emitter(fixtures[fixture], channel) !=
+                  EMITTER_DIMMER_FINE ||
+          (channel_is_fixture_only(fixtures[fixture].fixture_base_address +
+                  channel - 1, fixture) &&
+          channel_is_fixture_only(fixtures[fixture].fixture_base_address +
+                  channel, fixture))) &&
+          fixture_fine_channels_are_valid(fixture, channel + 1));
+}
 
-// DmxMaster doesn't support more channels on "small memory" devices.
-// If you have more than 128 active channels, you probably need a lightboard.
-#define MAX_DMX_CHANNELS 128
+constexpr bool fine_channels_are_valid(const byte fixture = 0) {
+  return fixture >= MAX_FIXTURE_COUNT ||
+          (fixture_fine_channels_are_valid(fixture) &&
+          fine_channels_are_valid(fixture + 1));
+}
+
+constexpr bool chase_steps_are_valid(const chase_data chase,
+        const byte step = 0) {
+  return step >= chase.step_count ||
+          (chase.steps[step].scene < MAX_SCENE_COUNT &&
+          chase_steps_are_valid(chase, step + 1));
+}
+
+constexpr bool chases_are_valid(const byte i = 0) {
+  return i >= CHASE_COUNT ||
+          (chases[i].step_count > 0 && chase_steps_are_valid(chases[i]) &&
+          chases_are_valid(i + 1));
+}
+
+constexpr bool fixed_channels_are_valid(const byte i = 0) {
+  return i >= NUMBER_OF_FIXED_CHANNELS ||
+          (is_valid_dmx_channel(fixed_channels[i].channel) &&
+          fixed_channels_are_valid(i + 1));
+}
+
+constexpr bool htp_channels_are_valid(const byte i = 0) {
+  return i >= HTP_CHANNEL_COUNT ||
+          (is_valid_dmx_channel(htp_channels[i]) &&
+          htp_channels_are_valid(i + 1));
+}
+
+constexpr bool submaster_channels_are_valid(const byte i = 0) {
+  return i >= SUBMASTER_CHANNEL_COUNT ||
+          (is_valid_dmx_channel(submaster_channels[i].channel) &&
+          submaster_channels[i].submaster > 0 &&
+          submaster_channels[i].submaster <= SUBMASTER_COUNT &&
+          submaster_channels_are_valid(i + 1));
+}
+
+/**
+ * Find the highest DMX channel used in the headers, for the length of the DMX
+ * frames.  Raw DMX channels above this make the frames longer as they're used.
+ */
+constexpr uint16_t max_channel(const uint16_t a, const uint16_t b) {
+  return a > b ? a : b;
+}
+
+constexpr uint16_t scene_max_channel(const byte slot = 0) {
+  return slot >= MAX_UNIQUE_CHANNELS ? 0 :
+          max_channel(scene_slot_to_channel_mapping[slot],
+                  scene_max_channel(slot + 1));
+}
+
+constexpr uint16_t fixture_max_channel(const byte fixture = 0) {
+  return fixture >= MAX_FIXTURE_COUNT ? 0 :
+          max_channel(fixtures[fixture].fixture_type == FIXTURE_UNUSED ? 0 :
+                  fixtures[fixture].fixture_base_address +
+                  get_fixture_channel_count(fixtures[fixture]) - 1,
+                  fixture_max_channel(fixture + 1));
+}
+
+constexpr uint16_t fixed_max_channel(const byte i = 0) {
+  return i >= NUMBER_OF_FIXED_CHANNELS ? 0 :
+          max_channel(fixed_channels[i].channel, fixed_max_channel(i + 1));
+}
+
+#define DMX_INITIAL_FRAME_CHANNELS max_channel(DMX_MIN_FRAME_CHANNELS,         \
+        max_channel(scene_max_channel(), max_channel(fixture_max_channel(),    \
+        fixed_max_channel())))
+
+/**
+ * Count the channels used by the fixtures, for sizing the channel entries.
+ * Channels shared with the scenes or another fixture get counted again, which
+ * wastes a few bytes, but is a lot simpler than finding the duplicates here.
+ */
+constexpr byte fixture_channel_count(const byte fixture = 0) {
+  return fixture >= MAX_FIXTURE_COUNT ? 0 :
+          get_fixture_channel_count(fixtures[fixture]) +
+          fixture_channel_count(fixture + 1);
+}
+
+static_assert(DMX_OUTPUT_CHANNELS <= MAX_DMX_CHANNELS &&
+        DMX_OUTPUT_CHANNELS <= DMX_SIZE,
+        "DMX_OUTPUT_CHANNELS is bigger than the DMX output supports");
+static_assert(DMX_MIN_FRAME_CHANNELS <= DMX_OUTPUT_CHANNELS,
+        "DMX_MIN_FRAME_CHANNELS is bigger than DMX_OUTPUT_CHANNELS");
+static_assert(scene_slots_are_valid(),
+        "SCENE_SLOTS has an invalid or duplicated DMX channel");
+static_assert(scene_index_is_valid(),
+        "scene_index uses a row that isn't in scene_rows");
+static_assert(fixture_profiles_are_valid(),
+        "fixture_profiles has too many channels, or a misplaced fine channel");
+static_assert(fixtures_are_valid(),
+        "fixtures has a fixture with an invalid DMX channel or type");
+static_assert(fine_channels_are_valid(),
+        "fixtures has a 16-bit dimmer channel that is used somewhere else");
+static_assert(htp_channels_are_valid(),
+        "htp_channels has an invalid DMX channel");
+static_assert(MASTER_MIDI_CHANNEL >= FADE_CURVE_COUNT,
+        "MASTER_MIDI_CHANNEL is the channel for one of the fade curves");
+static_assert(submaster_channels_are_valid(),
+        "submaster_channels has an invalid DMX channel or submaster");
+static_assert(chases_are_valid(),
+        "chases has an empty chase, or a step with an invalid scene");
+static_assert(fixed_channels_are_valid(),
+        "fixed_channels has an invalid DMX channel");
+
+// Midi can send roughly 1 command per millisecond.  After a command, wait a
+// little while for more commands before resuming main flow.  How long depends
+// on how quickly the host has been sending chained commands, but it's always
+// somewhere between these.  Generally, multiple commands per ms come in.
+#define COMMAND_CHAIN_MIN_MICROS 500
+#define COMMAND_CHAIN_MAX_MICROS 20000
+
+// Starting guess at the gap between chained commands, before any are seen.
+#define COMMAND_CHAIN_INITIAL_GAP_MICROS 1000
+
+// Number of received MIDI commands that can be queued up waiting to be run.
+// Must be a power of two.
+#define MIDI_QUEUE_SIZE 16
+
+// Number of MIDI inputs built in.  Each one gets an even share of the queue
+// every time the inputs are read, so a burst on one can't hold up the other.
+#if defined(USE_USB_MIDI) && defined(USE_SERIAL_MIDI)
+#define MIDI_INPUT_COUNT 2
+#else
+#define MIDI_INPUT_COUNT 1
+#endif
+#define MIDI_INPUT_QUEUE_SHARE (MIDI_QUEUE_SIZE / MIDI_INPUT_COUNT)
+
+// Number of fades that can run at the same time, each with their own timing.
+// Each command that starts a fade takes one until all its channels are done.
+// Must be 8 or less, as the in-use timelines are tracked in a byte.
+#define MAX_FADE_TIMELINES 8
+
+// Timeline index for a channel with a new target that hasn't started fading.
+#define FADE_PENDING 0xff
+
+// The most channel entries there can be: every channel in the headers, the
+// masters, and the raw channel pool.  Entries are indexed with a byte, and 0xff
+// means none.
+#define MAX_CHANNEL_ENTRIES (MAX_UNIQUE_CHANNELS + fixture_channel_count() +   \
+        NUMBER_OF_FIXED_CHANNELS + MASTER_COUNT + RAW_CHANNEL_POOL_SIZE)
+#define NO_CHANNEL_ENTRY 0xff
+#define CHANNEL_BITMAP_SIZE ((MAX_CHANNEL_ENTRIES + 7) / 8)
+
+// The masters are channel entries too, so they fade and get stored just like
+// the channels.  Their addresses are past the end of any DMX universe, so they
+// never go out.
+#define MASTER_ADDRESS_BASE 0xff00
+#define MASTER_ADDRESS(master) (MASTER_ADDRESS_BASE + (master))
+
+// channel_masters flags.  The low bits are the submaster.
+#define CHANNEL_SUBMASTER_MASK 0x7f
+#define CHANNEL_NO_GRAND_MASTER 0x80
+
+static_assert(MAX_CHANNEL_ENTRIES < NO_CHANNEL_ENTRY,
+        "Too many DMX channels in use to track them all");
+
+/**
+ * EEPROM log record layout.  Each record is a type byte, a 16-bit sequence
+ * number, a count, the data, and a CRC.  The data is a list of channels, each
+ * one the 16-bit DMX channel and the value.  Delta records hold the channels
+ * that have changed, and snapshot records hold every channel in use.  Snapshot
+ * records also have the 32-bit layout fingerprint between the count and the
+ * data.
+ */
+#define EEPROM_RECORD_DELTA 0x5a
+#define EEPROM_RECORD_SNAPSHOT 0xa5
+#define EEPROM_RECORD_HEADER_SIZE 4
+#define EEPROM_ENTRY_SIZE 3
+#define EEPROM_MAX_DELTA_ENTRIES 16
+#define EEPROM_FINGERPRINT_SIZE 4
+#define EEPROM_RECORD_SIZE(count) (EEPROM_RECORD_HEADER_SIZE +                 \
+        (EEPROM_ENTRY_SIZE * (count)) + 1)
+#define EEPROM_SNAPSHOT_SIZE(count) (EEPROM_RECORD_SIZE(count) +               \
+        EEPROM_FINGERPRINT_SIZE)
+#define EEPROM_MAX_RECORD_SIZE EEPROM_SNAPSHOT_SIZE(MAX_CHANNEL_ENTRIES)
 
-// Midi can send roughly 1 command per millisecond.  Wait up to this time after
-// sending a command for more commands before resuming main flow.
-// Generally, multiple commands per ms come in.
-#define COMMAND_CHAIN_DELAY_MS 3
+static_assert(EEPROM_MAX_RECORD_SIZE <= (E2END + 1) / 4,
+        "Too many DMX channels in use to fit a snapshot in the EEPROM log");
+
+// Snapshot half value for when there's no valid snapshot in the log.
+#define EEPROM_NO_SNAPSHOT 0xff
 
 /**
- * Extern memory buffer defined in DmxMaster.cpp.  To avoid any blips in the
- * lighting output on a restart, the stored values are put into this buffer
- * directly before starting the DMX output signal.  Lights will hold onto the
- * old value if they do not receive an update, but DmxMaster initializes the
- * buffer to all 0s, so updating with the normal writes, while the output is
- * alive, could cause a visible glitch in the lighting.  By writing the values
- * here, the lighting will always stay where it was before (unless power is
- * interrupted in the middle of a fade - then the old scene will load).
+ * Channel entries.  A full universe of fade state won't fit in the SRAM, and
+ * only a handful of channels are ever used anyway, so the state is only kept
+ * for the channels in the headers (the scenes, fixtures and fixed channels),
+ * and a small pool for the channels set in raw DMX channel mode.  Each entry
+ * holds the DMX channel it is for, and the state for it is kept in the arrays
+ * below, at the same index.
  * 
- * DMX_SIZE is defined in DmxMaster.h
+ * The scene channels are always the first entries, in the same order as the
+ * scene slots, so the scenes don't need to look up their channels.  Everything
+ * else looks the entry up by DMX channel when its command comes in.
  */
-extern volatile uint8_t dmxBuffer[DMX_SIZE];
+uint16_t channel_addresses[MAX_CHANNEL_ENTRIES];
+byte channel_entry_count = 0;
+
+// The number of entries for the channels in the headers.  The raw channel pool
+// entries come after these.
+byte header_entry_count = 0;
+
+// The fine channels of the 16-bit dimmers.  Each one's entry is straight after
+// its coarse channel's, and it fades and goes out along with it.
+byte fine_bitmap[CHANNEL_BITMAP_SIZE] = {0};
 
 /**
  * For fades, the fader needs the start state, the end state, and the progress
- * through the fade.
+ * through the fade.  These are all indexed by channel entry.
  * 
  * fade_start_values is the start state, and will be updated to match the target
  * of the fade at the conclusion of the fade.
  * fade_target_values is the desired end state of the fade.
+ * channel_values is the current state, before the masters are applied.  What
+ * actually goes out, after the masters, is in dmxBuffer.
+ * 
+ * This is a second copy of every channel.  dmxBuffer used to be the only one,
+ * but with the masters, the value in it can't be turned back into the value
+ * before them (a master at 0 leaves nothing to get it back from), and that's
+ * needed to start a fade from, and to write the channel out again when a
+ * master moves.  The masters can't go in the DMX output instead, as DmxMaster
+ * sends the buffer as it is.  So the copy is back, at a byte per channel
+ * entry, and a second store for each channel the fader moves.
+ * 
+ * Each fade has a timeline: the fade clock (see get_fade_clock()) at the start
+ * of the fade, how long the fade runs for, how far through the fade each
+ * millisecond moves it (worked out once, so the fader never has to divide),
+ * and the fade curve from fade_curves.h.  The fade position is a 16-bit
+ * fraction, 0-65535 of the way through.  Every command that starts a fade gets
+ * its own timeline, so a quick fixture change doesn't get stuck behind a slow
+ * scene fade, and the channels in the slow fade don't get restarted.  The bits
+ * in fade_timeline_mask are set for timelines that still have channels fading.
+ * 
+ * The commands in a chain share timelines: the fades they start are staged (the
+ * bits in fade_staged_mask are set for those timelines), and every command with
+ * the same fade time and curve goes on the same one.  They all start together
+ * when the chain is over, so the fade runs for exactly the time that was sent,
+ * however many commands went into it.
+ * 
+ * As each channel finishes its fade, the new value is queued up to be written
+ * to the EEPROM to be restored on power-on.
+ */
+byte fade_start_values[MAX_CHANNEL_ENTRIES] = {0};
+byte fade_target_values[MAX_CHANNEL_ENTRIES] = {0};
+byte channel_values[MAX_CHANNEL_ENTRIES] = {0};
+
+/**
+ * Master state.  Each channel has its submaster (0 for none) in
+ * channel_masters, and CHANNEL_NO_GRAND_MASTER set if the grand master leaves
+ * it alone.  The master entries are in order from master_entry_base, and
+ * masters_changed is set when one of them moves, so every channel is written
+ * out again with the new level.
+ */
+byte channel_masters[MAX_CHANNEL_ENTRIES] = {0};
+byte master_entry_base = 0;
+bool masters_changed = false;
+
+typedef struct {
+  uint32_t start_millis;
+  uint32_t duration_millis;
+  uint32_t position_step;
+  byte curve;
+} fade_timeline;
+
+fade_timeline fade_timelines[MAX_FADE_TIMELINES];
+byte fade_timeline_mask = 0;
+byte fade_staged_mask = 0;
+
+/**
+ * Sync state.  sync_tick_clock is the fade clock at the last MIDI clock tick,
+ * and sync_tick_local_millis is the value of millis() when it came in.  The
+ * sync master also keeps the value of millis() its next tick is due at.
+ * 
+ * The ticks are SYNC_TICK_MILLIS apart: 20ms is the MIDI clock at 125 BPM.  If
+ * no tick turns up for SYNC_TIMEOUT_MILLIS, the fades carry on from millis()
+ * until the clock comes back.
+ */
+#ifdef SYNC_MIDI_CLOCK
+#define SYNC_TICK_MILLIS 20
+#define SYNC_TIMEOUT_MILLIS 100
+
+uint32_t sync_tick_clock = 0;
+uint32_t sync_tick_local_millis = 0;
+#ifdef SYNC_MASTER
+uint32_t sync_next_tick_millis = 0;
+#endif
+#endif
+
+/**
+ * Layer state, indexed by channel entry (see layers.h).  layer_values holds the
+ * value each layer wants for each channel, and channel_layers has a bit set for
+ * each layer that is holding the channel.  channel_latest_layer is the layer
+ * that set the channel most recently, for the LTP channels, and the HTP
+ * channels have their bit set in htp_bitmap.
  * 
- * The actual state only lives in the DmxMaster class - no need to duplicate it.
+ * The commands only change the layer values, and set the channel's bit in the
+ * layer's dirty bitmap.  compose_layers() then works out the new targets for
+ * just the dirty channels, so a command touching a few channels doesn't have
+ * the whole lot worked out again.
+ */
+byte layer_values[LAYER_COUNT][MAX_CHANNEL_ENTRIES];
+byte channel_layers[MAX_CHANNEL_ENTRIES] = {0};
+byte channel_latest_layer[MAX_CHANNEL_ENTRIES];
+byte htp_bitmap[CHANNEL_BITMAP_SIZE] = {0};
+byte layer_dirty_bitmap[LAYER_COUNT][CHANNEL_BITMAP_SIZE] = {{0}};
+
+/**
+ * Active channel list.  Only a handful of the channels are changed by each
+ * command, so rather than having the fader walk every channel entry on every
+ * pass, the command handlers add any entry whose target changes to this list,
+ * and the fader only looks at the channels in here.
+ * 
+ * The bitmap tracks which channels are already in the list, so a channel set
+ * by several commands in a chain is only added once.  Each channel in the list
+ * also notes the fade timeline it is running on (or FADE_PENDING, before the
+ * fade is started), and is dropped from the list when its fade completes.
+ */
+byte active_channels[MAX_CHANNEL_ENTRIES];
+byte active_channel_timelines[MAX_CHANNEL_ENTRIES];
+byte active_channel_count = 0;
+byte active_channel_bitmap[CHANNEL_BITMAP_SIZE] = {0};
+
+/**
+ * Channels that have finished a fade, and whose value may need to be written to
+ * EEPROM.  EEPROM writes are slow, so these are written out one at a time in
+ * the background by store_current_to_eeprom().  A channel that changes again
+ * before it is written just gets written with the newer value.
+ */
+byte eeprom_dirty_bitmap[CHANNEL_BITMAP_SIZE] = {0};
+
+/**
+ * The EEPROM is used as a log, rather than one fixed byte per channel, so the
+ * same cells don't get written on every scene change.  Each finished batch of
+ * channels is appended to the log as a small delta record, and the log wraps
+ * around when it reaches the end of the EEPROM.
  * 
- * fade_start_millis and fade_end_millis are the values of millis() at the start
- * and target end of the fade.  The fade will be calculated based on these.  If
- * a fade is not in progress, reset these both to 0.
+ * Deltas are no good without something to apply them to, so the first record
+ * written in each half of the EEPROM is a snapshot of all the channels.  The
+ * newest snapshot is always in the other half from the one being overwritten,
+ * so a power cut in the middle of a write can only ever lose the record being
+ * written.
+ * 
+ * head is the offset the next record is written at, and sequence is the
+ * sequence number for it.  snapshot_half is the half (0 or 1) holding the
+ * newest snapshot.  The rest is the record being written, one byte per pass:
+ * type is zero if no record is being written, index is the next byte of it,
+ * entry is the channel entry being written, and part is the next byte of that
+ * entry (0 and 1 for the DMX channel, 2 for the value).
+ */
+typedef struct {
+  uint16_t head;
+  uint16_t sequence;
+  byte snapshot_half;
+  byte type;
+  byte count;
+  uint16_t length;
+  uint16_t index;
+  byte entry;
+  byte part;
+  byte crc;
+} eeprom_log_state;
+
+eeprom_log_state eeprom_log = {0, 0, EEPROM_NO_SNAPSHOT, 0, 0, 0, 0, 0, 0, 0};
+
+/**
+ * Received MIDI commands, waiting to be run.  This is a ring buffer: head is
+ * where the next command received goes, and tail is the next command to run.
+ * Both just count up and wrap, and are masked to get the position.
+ */
+midi_command midi_queue[MIDI_QUEUE_SIZE];
+byte midi_queue_head = 0, midi_queue_tail = 0;
+
+/**
+ * Command chain timing.  The gaps between commands that come in close together
+ * are tracked the same way TCP tracks round trip times: a smoothed average gap
+ * (scaled by 8) and a smoothed mean deviation (scaled by 4).  The chain is over
+ * once there has been no command for the average gap plus four times the
+ * deviation, which a host that sends its chains steadily will almost never
+ * take.
  * 
- * After a fade, the current values are written to the EEPROM to be restored on
- * power-on.
+ * command_chain_committed is set by an explicit commit command, to end the
+ * chain right away without waiting at all.
+ */
+uint32_t last_command_micros = 0;
+uint32_t command_gap_average_x8 = COMMAND_CHAIN_INITIAL_GAP_MICROS * 8;
+uint32_t command_gap_deviation_x4 = COMMAND_CHAIN_INITIAL_GAP_MICROS * 2;
+bool command_chain_committed = false;
+
+// The DMX frame count when the fader last ran, or the value of micros() when it
+// should next run, by the estimate.
+#ifdef DMX_OUTPUT_COUNTS_FRAMES
+byte fader_frame_count = 0;
+#else
+uint32_t next_frame_micros = 0;
+#endif
+
+// The number of channels in each DMX frame, and how long each frame takes.
+// These only ever grow, as raw DMX channels above the ones in the headers are
+// used.  dmx_output_started is set once the frames are going out, so changes
+// go straight to the DMX output.
+uint16_t dmx_frame_channels = DMX_INITIAL_FRAME_CHANNELS;
+uint32_t dmx_frame_micros = DMX_FRAME_MICROS(DMX_INITIAL_FRAME_CHANNELS);
+bool dmx_output_started = false;
+
+// Chase speed that runs the steps at the times in chases.h.
+#define CHASE_RATE_NORMAL 64
+#define NO_CHASE 0xff
+
+/**
+ * The running chase, or NO_CHASE.  Each step starts at the fade clock value
+ * in step_start_millis, and the next one starts step_millis later (the fade
+ * and hold times, scaled by the rate).  The curve is the fade curve for every
+ * step in the chase.
  */
-byte fade_start_values[MAX_DMX_CHANNELS] = {0};
-byte fade_target_values[MAX_DMX_CHANNELS] = {0};
-byte fade_current_values[MAX_DMX_CHANNELS] = {0};
-uint32_t fade_start_millis = 0, fade_end_millis = 0;
+typedef struct {
+  byte chase;
+  byte step;
+  byte rate;
+  byte curve;
+  uint32_t step_start_millis;
+  uint32_t step_millis;
+} chase_state;
 
-// True if the scene is stored to EEPROM.
-bool scene_is_stored_to_eeprom = 0;
+chase_state running_chase = {NO_CHASE, 0, 0, 0, 0, 0};
 
 #ifdef PRINT_STATE
 uint32_t last_print_time = 0;
 #endif
 
+/**
+ * Performance counters, to see how the converter is keeping up on the real
+ * hardware.  Each stage keeps the total and the longest time spent in it, in
+ * microseconds: running each command, each command chain (from the first
+ * command to the end of the chain window), and each pass of the fader and the
+ * EEPROM writer.  poll_gap_max is the longest the loop has gone without looking
+ * for MIDI commands.
+ * 
+ * The latency histogram counts how long it took from the first command in a
+ * chain coming in to the fader writing out the result.  Each bucket covers
+ * twice the time of the one before, from under 0.5ms, to 32ms and up.
+ * 
+ * invalid_messages counts MIDI messages that aren't commands, dropped_commands
+ * counts commands that couldn't be run (unused fixtures, or the raw channel
+ * pool being full), and queue_full counts the times the MIDI queue filled up.
+ */
+#ifdef PERF_COUNTERS
+#define PERF_STAGE_COMMANDS 0
+#define PERF_STAGE_CHAIN 1
+#define PERF_STAGE_FADER 2
+#define PERF_STAGE_EEPROM 3
+#define PERF_STAGE_COUNT 4
+
+#define PERF_LATENCY_BUCKETS 8
+#define PERF_LATENCY_FIRST_BUCKET_MICROS 500
+
+typedef struct {
+  uint32_t total_micros;
+  uint32_t max_micros;
+} perf_stage;
+
+typedef struct {
+  uint32_t loop_count;
+  uint32_t chain_count;
+  uint32_t poll_gap_max;
+  perf_stage stages[PERF_STAGE_COUNT];
+  uint16_t invalid_messages;
+  uint16_t dropped_commands;
+  uint16_t queue_full;
+  uint16_t latency_histogram[PERF_LATENCY_BUCKETS];
+} perf_counters;
+
+perf_counters perf;
+uint32_t last_poll_micros = 0;
+
+// The value of micros() when the DMX output started, counted from power up (or
+// the reset).  This isn't cleared with the other counters.
+uint32_t dmx_start_micros = 0;
+
+#define PERF_COUNT(counter) (perf.counter++)
+#else
+#define PERF_COUNT(counter)
+#endif
+
+/**
+ * MIDI capture.  Each command that is queued up is also put in this ring, with
+ * the value of micros() when it came in.  When the command starts a fade,
+ * fade_delay_micros is set to how long after that the fade started, at the end
+ * of the chain (or MIDI_CAPTURE_NO_FADE if it didn't start one).  This shows
+ * where the time went when the lights are late: waiting for the command,
+ * waiting for the rest of the chain, or in the converter.
+ * 
+ * The capture entries line up with the MIDI queue - the command at each queue
+ * position is in the capture entry at the same position - so there's no need
+ * to track where the next one goes.  midi_capture_running is the entry of the
+ * command being run, or MIDI_CAPTURE_NONE.
+ */
+#ifdef MIDI_CAPTURE
+// Must be a power of two, and at least MIDI_QUEUE_SIZE.
+#define MIDI_CAPTURE_SIZE 16
+#define MIDI_CAPTURE_NO_FADE 0xffff
+#define MIDI_CAPTURE_STAGED 0xfffe
+#define MIDI_CAPTURE_NONE 0xff
+
+static_assert(MIDI_CAPTURE_SIZE >= MIDI_QUEUE_SIZE,
+        "MIDI_CAPTURE_SIZE is smaller than the MIDI queue");
+
+typedef struct {
+  midi_command command;
+  uint32_t received_micros;
+  uint16_t fade_delay_micros;
+} midi_capture_entry;
+
+midi_capture_entry midi_capture[MIDI_CAPTURE_SIZE];
+byte midi_capture_count = 0;
+byte midi_capture_running = MIDI_CAPTURE_NONE;
+#endif
+
+/**
+ * Telemetry.  While the host has it turned on, the state is sent back over USB
+ * MIDI whenever it changes, but no more often than every
+ * TELEMETRY_INTERVAL_MILLIS, so a long fade doesn't flood the host or hold up
+ * the fader.  Each message carries at most TELEMETRY_MAX_CHANNELS channels, and
+ * the rest wait for the next one.
+ * 
+ * Nothing waits on the host to read the telemetry.  A message is only sent when
+ * there's room for the biggest one in the USB send buffer, so sending it never
+ * blocks, and if the host stops reading, the messages just stop.
+ * 
+ * telemetry_dirty_bitmap has a bit set for each channel entry whose value has
+ * changed since it was last sent.  The fade and EEPROM state sent last is kept
+ * so it's only sent again when it changes.
+ */
+#ifdef TELEMETRY
+#define TELEMETRY_INTERVAL_MILLIS 100
+#define TELEMETRY_MAX_CHANNELS 6
+
+// The biggest message, in USB MIDI packets of 3 SysEx bytes: 8 bytes of header,
+// flags, fade mask, channel count and the end, a byte per fade timeline, and 5
+// bytes per channel.
+#define TELEMETRY_MAX_PACKETS ((8 + MAX_FADE_TIMELINES +                       \
+        TELEMETRY_MAX_CHANNELS * 5 + 2) / 3)
+
+static_assert(TELEMETRY_MAX_PACKETS <= USB_MIDI_SEND_BUFFER_PACKETS,
+        "The biggest telemetry message doesn't fit in the USB send buffer");
+
+// The flags in each message.
+#define TELEMETRY_FADE_ACTIVE 0x01
+#define TELEMETRY_EEPROM_COMMITTED 0x02
+
+bool telemetry_enabled = false;
+uint32_t telemetry_sent_millis = 0;
+byte telemetry_dirty_bitmap[CHANNEL_BITMAP_SIZE] = {0};
+byte telemetry_flags = 0;
+byte telemetry_fade_mask = 0;
+byte telemetry_fade_progress[MAX_FADE_TIMELINES] = {0};
+#endif
+
 /**
  * One problem encountered during development: Power blips.  If the presentation
  * machine USB bus is reset, the converter resets, which means that the start
@@ -84,530 +827,2638 @@ uint32_t last_print_time = 0;
  * the DMX channels to some safe default values (all black, except for the fixed
  * channels).
  * 
- * Identifying when the code has changed on Arduino is a bit tricky (there are
- * no build numbers), but a quick hash of the compile date/time stamp is good
- * enough for most uses (theoretically, once every 256 builds, there will be a
- * collision, but this is unlikely enough for common uses).
+ * What matters is whether the stored data still means the same thing, not
+ * whether the code has changed: a rebuild that only fixes a bug in the fader
+ * should come back with the lights where they were.  So the EEPROM log is
+ * tagged with a fingerprint of everything that decides what gets stored - the
+ * scene channels, the fixtures, the fixed channels, the universe size, and the
+ * record format.  It's a 32-bit FNV-1a hash, worked out by the compiler, so
+ * there's nothing to calculate at startup.
+ * 
+ * Every snapshot record holds the fingerprint, and the low byte of it seeds the
+ * CRC of every record.  If the newest snapshot matches, then the stored channel
+ * data is restored, as this was a power cycle or a code change.  If it does
+ * not, then the lighting setup has changed, and the defaults are used.  A
+ * changed setup only has a 1 in 4 billion chance of looking the same.
+ */
+#define FNV_OFFSET_BASIS 2166136261UL
+#define FNV_PRIME 16777619UL
+
+constexpr uint32_t fingerprint_byte(const uint32_t hash, const byte value) {
+  return (hash ^ value) * FNV_PRIME;
+}
+
+constexpr uint32_t fingerprint_word(const uint32_t hash, const uint16_t value) {
+  return fingerprint_byte(fingerprint_byte(hash, value & 0xff), value >> 8);
+}
+
+constexpr uint32_t fingerprint_scene_slots(const uint32_t hash,
+        const byte slot = 0) {
+  return slot >= MAX_UNIQUE_CHANNELS ? hash :
+          fingerprint_scene_slots(fingerprint_word(hash,
+                  scene_slot_to_channel_mapping[slot]), slot + 1);
+}
+
+constexpr uint32_t fingerprint_fixtures(const uint32_t hash,
+        const byte fixture = 0) {
+  return fixture >= MAX_FIXTURE_COUNT ? hash :
+          fingerprint_fixtures(fingerprint_word(fingerprint_byte(hash,
+                  fixtures[fixture].fixture_type),
+                  fixtures[fixture].fixture_base_address), fixture + 1);
+}
+
+constexpr uint32_t fingerprint_fixed_channels(const uint32_t hash,
+        const byte i = 0) {
+  return i >= NUMBER_OF_FIXED_CHANNELS ? hash :
+          fingerprint_fixed_channels(fingerprint_byte(fingerprint_word(hash,
+                  fixed_channels[i].channel), fixed_channels[i].value), i + 1);
+}
+
+constexpr uint32_t layout_fingerprint() {
+  return fingerprint_fixed_channels(fingerprint_fixtures(
+          fingerprint_scene_slots(fingerprint_byte(fingerprint_word(
+                  FNV_OFFSET_BASIS, MAX_DMX_CHANNELS), EEPROM_ENTRY_SIZE))));
+}
+
+constexpr uint32_t LAYOUT_FINGERPRINT = layout_fingerprint();
+#define EEPROM_CRC_SEED ((byte)LAYOUT_FINGERPRINT)
+
+/**
+ * Print the state, if enabled.  This is useful for debugging without a full
+ * set of lights.
+ */
+#ifdef PRINT_STATE
+void print_state() {
+  Serial.println(F("====Current Channel State===="));
+  for (uint8_t i = 0; i < channel_entry_count; i++) {
+    Serial.print(F("["));
+    Serial.print(channel_addresses[i]);
+    Serial.print(F("]: "));
+    Serial.println(channel_values[i]);
+  }
+}
+#endif
+
+/**
+ * Find the channel entry for a DMX channel.  This is a plain search, but it's
+ * only done as commands come in, never in the fader.
+ * 
+ * @param address The DMX channel (1-512).
+ * @return The channel entry, or NO_CHANNEL_ENTRY if there isn't one.
+ */
+byte find_channel_entry(const uint16_t address) {
+  for (byte i = 0; i < channel_entry_count; i++) {
+    if (channel_addresses[i] == address) {
+      return i;
+    }
+  }
+  return NO_CHANNEL_ENTRY;
+}
+
+/**
+ * Check if a channel entry is the fine channel of a 16-bit dimmer.
+ * 
+ * @param entry The channel entry.
+ * @return True if it's a fine channel.
+ */
+bool is_fine_channel_entry(const byte entry) {
+  return fine_bitmap[entry >> 3] & (1 << (entry & 0x7));
+}
+
+/**
+ * Find the fine channel that goes with a 16-bit dimmer's coarse channel.
+ * 
+ * @param entry The channel entry.
+ * @return The fine channel entry, or NO_CHANNEL_ENTRY if the channel is not
+ *   the coarse channel of a 16-bit dimmer.
+ */
+byte get_fine_channel_entry(const byte entry) {
+  byte fine = entry + 1;
+  
+  if (fine >= channel_entry_count || !is_fine_channel_entry(fine)) {
+    return NO_CHANNEL_ENTRY;
+  }
+  return fine;
+}
+
+/**
+ * Make the DMX frames long enough to carry a channel.  The masters, and any
+ * channels past the highest one that can be used, are ignored.
+ * 
+ * @param address The DMX channel.
+ */
+void include_dmx_channel(const uint16_t address) {
+  if (address <= dmx_frame_channels || address > DMX_OUTPUT_CHANNELS) return;
+  
+  dmx_frame_channels = address;
+  dmx_frame_micros = DMX_FRAME_MICROS(address);
+  if (dmx_output_started) {
+    set_dmx_output_channels(address);
+  }
+}
+
+/**
+ * Check if the next DMX frame is due, so the fader should run.  With the UART
+ * output, that's when another frame has finished since the fader last ran.
+ * DmxMaster doesn't say when it has finished a frame, so with that this goes by
+ * micros(), and the frame length from DMX_FRAME_MICROS.  That's only an
+ * estimate, worked out from the DMX timing rather than the frames actually
+ * going out, so the fader can drift a little against them, but it's near
+ * enough to run it about once a frame.
  * 
- * The compile date/time are hashed into a byte that is used as a magic at the
- * start of the EEPROM (DMX channel 0 is not a valid channel, so the magic goes
- * into this channel, effectively).  If the magic matches, then the stored
- * channel data is restored, as this was a power cycle.  If the magic does not
- * match, then this must be a new build, and the defaults are used.  It's not
- * the cleanest approach, but it's good enough for casual use.  One could
- * increase the size of the hash if one wanted better collision resistance.
+ * @return True if the fader should run.
+ */
+bool dmx_frame_due() {
+#ifdef DMX_OUTPUT_COUNTS_FRAMES
+  return get_dmx_frame_count() != fader_frame_count;
+#else
+  return (int32_t)(micros() - next_frame_micros) >= 0;
+#endif
+}
+
+/**
+ * The fader is running now, off the usual frame timing (at the end of a
+ * command chain, or the first frame).  Time the frames from here.
  */
+void restart_frame_timing() {
+#ifdef DMX_OUTPUT_COUNTS_FRAMES
+  fader_frame_count = get_dmx_frame_count();
+#else
+  next_frame_micros = micros();
+#endif
+}
 
-// Static value based on compile time.  As the headers are included in this
-// file, any change to the headers will rebuild this file.
-// Stored in PROGMEM, as is good and proper for constants.
-const char PROGMEM compile_date[] = __DATE__ " " __TIME__;
+/**
+ * The fader has run, so wait for the next DMX frame.  If the loop has fallen a
+ * whole frame behind (a long command chain), skip the missed frames instead of
+ * running the fader several times in a row to catch up.
+ */
+void schedule_next_frame() {
+#ifdef DMX_OUTPUT_COUNTS_FRAMES
+  fader_frame_count = get_dmx_frame_count();
+#else
+  next_frame_micros += dmx_frame_micros;
+  if (dmx_frame_due()) {
+    next_frame_micros = micros() + dmx_frame_micros;
+  }
+#endif
+}
+
+/**
+ * Find the channel entry for a DMX channel, adding a new one if there isn't
+ * one yet.  Once all the entries are used up, new channels are ignored.
+ * 
+ * @param address The DMX channel (1-512).
+ * @return The channel entry, or NO_CHANNEL_ENTRY if there's no room for it.
+ */
+byte add_channel_entry(const uint16_t address) {
+  byte entry = find_channel_entry(address);
+  
+  if (entry == NO_CHANNEL_ENTRY && channel_entry_count < MAX_CHANNEL_ENTRIES) {
+    entry = channel_entry_count++;
+    channel_addresses[entry] = address;
+    include_dmx_channel(address);
+    for (byte i = 0; i < HTP_CHANNEL_COUNT; i++) {
+      if (pgm_read_word_near(&htp_channels[i]) == address) {
+        htp_bitmap[entry >> 3] |= 1 << (entry & 0x7);
+      }
+    }
+    for (byte i = 0; i < SUBMASTER_CHANNEL_COUNT; i++) {
+      if (pgm_read_word_near(&submaster_channels[i].channel) == address) {
+        channel_masters[entry] =
+                pgm_read_byte_near(&submaster_channels[i].submaster);
+      }
+    }
+  }
+  return entry;
+}
+
+/**
+ * Add the channel entries for every channel used in the headers.  The scene
+ * channels go first, so each scene slot is the channel entry of the same
+ * number - they're all different channels, so none of them are merged.  The
+ * raw DMX channels get added after these as they're used.
+ */
+void setup_channel_entries() {
+  for (byte i = 0; i < MAX_UNIQUE_CHANNELS; i++) {
+    add_channel_entry(pgm_read_word_near(&scene_slot_to_channel_mapping[i]));
+  }
+  
+  // The 16-bit dimmer channels aren't used anywhere else, so each fine channel
+  // is always added straight after its coarse channel.
+  for (byte i = 0; i < MAX_FIXTURE_COUNT; i++) {
+    fixture_data fixture;
+    fixture_profile profile;
+    
+    memcpy_P(&fixture, &fixtures[i], sizeof(fixture_data));
+    memcpy_P(&profile,
+            &fixture_profiles[FIXTURE_TYPE_INDEX(fixture.fixture_type)],
+            sizeof(fixture_profile));
+    for (byte channel = 0; channel < profile.channel_count; channel++) {
+      byte entry = add_channel_entry(fixture.fixture_base_address + channel);
+      if (profile.layout[channel] == EMITTER_DIMMER_FINE) {
+        fine_bitmap[entry >> 3] |= 1 << (entry & 0x7);
+      }
+    }
+  }
+  
+  // The fixed channels hold their values on the fixed layer from the start.
+  for (byte i = 0; i < NUMBER_OF_FIXED_CHANNELS; i++) {
+    fixed_channel fixed;
+    byte entry;
+    
+    memcpy_P(&fixed, &fixed_channels[i], sizeof(fixed_channel));
+    entry = add_channel_entry(fixed.channel);
+    layer_values[LAYER_FIXED][entry] = fixed.value;
+    channel_layers[entry] |= 1 << LAYER_FIXED;
+    channel_latest_layer[entry] = LAYER_FIXED;
+    channel_masters[entry] |= CHANNEL_NO_GRAND_MASTER;
+  }
+  
+  // The masters start out at full.
+  master_entry_base = channel_entry_count;
+  for (byte i = 0; i < MASTER_COUNT; i++) {
+    byte entry = add_channel_entry(MASTER_ADDRESS(i));
+    fade_start_values[entry] = 255;
+    fade_target_values[entry] = 255;
+    channel_values[entry] = 255;
+  }
+  
+  header_entry_count = channel_entry_count;
+}
+
+/**
+ * Records never wrap around the end of the EEPROM.  If there isn't room for
+ * the biggest record at the given offset, the next record goes at the start.
+ * 
+ * @param offset The offset just past the end of the last record.
+ * @return The offset the next record is written at.
+ */
+uint16_t next_eeprom_record_offset(const uint16_t offset) {
+  if (eeprom_length() - offset < EEPROM_MAX_RECORD_SIZE) {
+    return 0;
+  }
+  return offset;
+}
+
+/**
+ * Read the sequence number of the record at the given offset.
+ * 
+ * @param offset The EEPROM offset of the record.
+ * @return The 16-bit sequence number from the record header.
+ */
+uint16_t read_eeprom_record_sequence(const uint16_t offset) {
+  return read_eeprom(offset + 1) | ((uint16_t)read_eeprom(offset + 2) << 8);
+}
+
+/**
+ * Check if there is a valid record at the given offset: a known type, a count
+ * that makes sense for it, a matching layout fingerprint (for snapshots), and a
+ * CRC that matches (seeded with the fingerprint, so records from a different
+ * lighting setup won't match).
+ * 
+ * @param offset The EEPROM offset to check.
+ * @return The length of the record, or 0 if there isn't a valid record here.
+ */
+uint16_t check_eeprom_record(const uint16_t offset) {
+  byte type = read_eeprom(offset);
+  byte count = read_eeprom(offset + 3);
+  uint16_t length;
+  byte crc;
+  
+  if (type == EEPROM_RECORD_DELTA) {
+    if (count == 0 || count > EEPROM_MAX_DELTA_ENTRIES) return 0;
+    length = EEPROM_RECORD_SIZE(count);
+  } else if (type == EEPROM_RECORD_SNAPSHOT) {
+    if (count > MAX_CHANNEL_ENTRIES) return 0;
+    length = EEPROM_SNAPSHOT_SIZE(count);
+  } else {
+    return 0;
+  }
+  
+  if (offset + length > eeprom_length()) return 0;
+  
+  if (type == EEPROM_RECORD_SNAPSHOT) {
+    for (byte i = 0; i < EEPROM_FINGERPRINT_SIZE; i++) {
+      if (read_eeprom(offset + EEPROM_RECORD_HEADER_SIZE + i) !=
+              (byte)(LAYOUT_FINGERPRINT >> (8 * i))) {
+        return 0;
+      }
+    }
+  }
+  
+  crc = EEPROM_CRC_SEED;
+  for (uint16_t i = 0; i < length - 1; i++) {
+    crc = crc8_update(crc, read_eeprom(offset + i));
+  }
+  
+  return (crc == read_eeprom(offset + length - 1)) ? length : 0;
+}
+
+/**
+ * Set a channel to a value restored from EEPROM.  This sets the start, target
+ * and current values - refresh_channel_outputs() puts them in the DMX array
+ * (extern hack) once everything is restored.  Raw DMX channels get their
+ * channel entries back as they're restored.  The masters are restored the same
+ * way, but don't go on a layer.
+ * 
+ * Only the output value is stored, not the layers, so the value is put back on
+ * the layer the channel belongs to: the scene layer for scene channels, the
+ * fixed layer for fixed channels, then the fixture and raw layers.
+ * 
+ * @param address The DMX channel (1-512).
+ * @param value The stored value for the channel.
+ */
+void restore_channel(const uint16_t address, const byte value) {
+  byte entry, layer;
+  
+  if (address >= MASTER_ADDRESS_BASE) {
+    entry = find_channel_entry(address);
+    if (entry == NO_CHANNEL_ENTRY) return;
+  } else {
+    if (!is_valid_dmx_channel(address)) return;
+    entry = add_channel_entry(address);
+    if (entry == NO_CHANNEL_ENTRY) return;
+  }
+  
+  if (entry >= master_entry_base && entry < master_entry_base + MASTER_COUNT) {
+    layer = LAYER_COUNT;
+  } else if (entry < MAX_UNIQUE_CHANNELS) {
+    layer = LAYER_SCENE;
+  } else if (channel_layers[entry] & (1 << LAYER_FIXED)) {
+    layer = LAYER_FIXED;
+  } else if (entry < header_entry_count) {
+    layer = LAYER_FIXTURE;
+  } else {
+    layer = LAYER_RAW;
+  }
+  if (layer < LAYER_COUNT) {
+    layer_values[layer][entry] = value;
+    channel_layers[entry] |= 1 << layer;
+    channel_latest_layer[entry] = layer;
+  }
+  
+  fade_start_values[entry] = value;
+  fade_target_values[entry] = value;
+  channel_values[entry] = value;
+}
+
+/**
+ * Apply a valid record from the EEPROM log to the channel state.  Delta and
+ * snapshot records hold their channels the same way, so this works for both.
+ * 
+ * @param offset The EEPROM offset of a record that passed check_eeprom_record().
+ */
+void apply_eeprom_record(const uint16_t offset) {
+  byte count = read_eeprom(offset + 3);
+  uint16_t data = offset + EEPROM_RECORD_HEADER_SIZE;
+  
+  if (read_eeprom(offset) == EEPROM_RECORD_SNAPSHOT) {
+    data += EEPROM_FINGERPRINT_SIZE;
+  }
+  
+  for (byte i = 0; i < count; i++) {
+    uint16_t address = read_eeprom(data) |
+            ((uint16_t)read_eeprom(data + 1) << 8);
+    restore_channel(address, read_eeprom(data + 2));
+    data += EEPROM_ENTRY_SIZE;
+  }
+}
+
+/**
+ * On power on, attempt to restore the settings from EEPROM.  This only happens
+ * if the layout fingerprint matches.  This will write the current state array,
+ * the future state field, and the DMX array (extern hack).  Call this BEFORE
+ * calling any of the DMX functions that will start sending out the data to the
+ * lights.
+ * 
+ * This finds the newest valid snapshot in the EEPROM log, then applies each
+ * record after it in turn, as long as the sequence numbers follow on and the
+ * records are valid.  The first record that doesn't is where the next record
+ * will be written.
+ * 
+ * If there is no valid snapshot, nothing is restored, and the next record
+ * written will be a new snapshot.
+ * 
+ * @return True if the data was restored, false if the fingerprint does not
+ *   match.
+ */
+bool restore_from_eeprom() {
+  uint16_t offset, snapshot_offset = 0, sequence = 0;
+  bool found_snapshot = false;
+  uint16_t length;
+  
+  for (offset = 0; offset + EEPROM_RECORD_SIZE(0) <= eeprom_length();
+          offset++) {
+    if (read_eeprom(offset) != EEPROM_RECORD_SNAPSHOT) continue;
+    if (!check_eeprom_record(offset)) continue;
+    
+    // Sequence numbers wrap, so compare them by difference.
+    uint16_t record_sequence = read_eeprom_record_sequence(offset);
+    if (!found_snapshot || (int16_t)(record_sequence - sequence) > 0) {
+      found_snapshot = true;
+      snapshot_offset = offset;
+      sequence = record_sequence;
+    }
+  }
+  
+  if (!found_snapshot) {
+    // Nothing from this build.  All channels stay zeroed.
+    return false;
+  }
+  
+  eeprom_log.snapshot_half = snapshot_offset >= (eeprom_length() / 2);
+  
+  offset = snapshot_offset;
+  while ((length = check_eeprom_record(offset)) &&
+          read_eeprom_record_sequence(offset) == sequence) {
+    apply_eeprom_record(offset);
+    sequence++;
+    offset = next_eeprom_record_offset(offset + length);
+  }
+  
+  eeprom_log.head = offset;
+  eeprom_log.sequence = sequence;
+  
+  return true;
+}
+
+/**
+ * Add a received command to the MIDI queue.  The receivers check for space
+ * before reading anything, so this doesn't need to.
+ */
+void push_midi_command(const midi_command command) {
+  midi_queue[midi_queue_head & (MIDI_QUEUE_SIZE - 1)] = command;
+#ifdef MIDI_CAPTURE
+  midi_capture_entry *entry =
+          &midi_capture[midi_queue_head & (MIDI_CAPTURE_SIZE - 1)];
+  entry->command = command;
+  entry->received_micros = micros();
+  entry->fade_delay_micros = MIDI_CAPTURE_NO_FADE;
+  if (midi_capture_count < MIDI_CAPTURE_SIZE) {
+    midi_capture_count++;
+  }
+#endif
+  midi_queue_head++;
+}
+
+/**
+ * Check how many more commands will fit in the MIDI queue.
+ */
+byte midi_queue_space() {
+  return MIDI_QUEUE_SIZE - (byte)(midi_queue_head - midi_queue_tail);
+}
+
+/**
+ * Take the oldest command out of the MIDI queue.
+ * 
+ * @param command Filled in with the command, if there is one.
+ * @return True if there was a command in the queue.
+ */
+bool pop_midi_command(midi_command *command) {
+  if (midi_queue_head == midi_queue_tail) {
+    return false;
+  }
+  *command = midi_queue[midi_queue_tail & (MIDI_QUEUE_SIZE - 1)];
+#ifdef MIDI_CAPTURE
+  midi_capture_running = midi_queue_tail & (MIDI_CAPTURE_SIZE - 1);
+#endif
+  midi_queue_tail++;
+  return true;
+}
+
+#ifdef PERF_COUNTERS
+/**
+ * Add the time since the start of a stage to the counters for it.
+ * 
+ * @param stage The stage, one of the PERF_STAGE values.
+ * @param start_micros The value of micros() when the stage started.
+ */
+void perf_record_stage(const byte stage, const uint32_t start_micros) {
+  uint32_t elapsed = micros() - start_micros;
+  
+  perf.stages[stage].total_micros += elapsed;
+  if (elapsed > perf.stages[stage].max_micros) {
+    perf.stages[stage].max_micros = elapsed;
+  }
+}
+
+/**
+ * Count a command chain's latency in the histogram.
+ * 
+ * @param latency_micros From the first command coming in to the fader running.
+ */
+void perf_record_latency(const uint32_t latency_micros) {
+  uint32_t limit = PERF_LATENCY_FIRST_BUCKET_MICROS;
+  byte bucket = 0;
+  
+  while (latency_micros >= limit && bucket < PERF_LATENCY_BUCKETS - 1) {
+    limit <<= 1;
+    bucket++;
+  }
+  perf.latency_histogram[bucket]++;
+}
+
+/**
+ * Note that the loop has looked for commands, and how long it's been since it
+ * last did.
+ */
+void perf_record_poll() {
+  uint32_t now = micros();
+  
+  if (now - last_poll_micros > perf.poll_gap_max) {
+    perf.poll_gap_max = now - last_poll_micros;
+  }
+  last_poll_micros = now;
+}
+#endif
+
+/**
+ * Turn a MIDI message into a midi_command structure.  Only the messages that
+ * are used for commands get a command code - anything else is returned with a
+ * zero command, and should be ignored.
+ * 
+ * @param status The status byte of the message.
+ * @param data0 The first data byte: Note or Controller.
+ * @param data1 The second data byte: Velocity or Value.
+ * @return The command.
+ */
+midi_command decode_midi_command(const byte status, const byte data0,
+        const byte data1) {
+  midi_command ret = {0, 0, 0, 0};
+  byte command;
+ 
+  // A MIDI command code has the hight bit set, 3 bits of command code, and the
+  // lower 4 are the channel.  Mask this out to see what the command is.
+  command = status & MIDI_COMMAND_MASK;
+  
+  if (command == MIDI_NOTE_ON) {
+    ret.command = COMMAND_SCENE;
+  } else if (command == MIDI_NOTE_OFF) {
+    ret.command = COMMAND_FIXTURE;
+  } else if (command == MIDI_CONTROL_CHANGE) {
+    ret.command = COMMAND_CHANNEL;
+  } else if (command == MIDI_PROGRAM_CHANGE) {
+    ret.command = COMMAND_COMMIT;
+  } else if (command == MIDI_POLY_PRESSURE) {
+    ret.command = COMMAND_CHASE;
+  } else if (command == MIDI_CHANNEL_PRESSURE) {
+    ret.command = COMMAND_RELEASE;
+  } else {
+    // Not a valid command, leave command as null to indicate nothing.
+    PERF_COUNT(invalid_messages);
+  }
+  
+  // MIDI channels are 1-16, not 0-15.  However, everything is 0 indexed in C.
+  ret.channel = (status & 0xf);
+  
+  // Copy the two data bytes: Note and Velocity.
+  ret.data0 = data0;
+  ret.data1 = data1;
+
+  return ret;
+}
+
+/**
+ * The fade clock, which every fade and chase is timed from.  Normally, this is
+ * simply millis().
+ * 
+ * With SYNC_MIDI_CLOCK, this is counted from the incoming MIDI clock instead:
+ * each tick moves the clock on by SYNC_TICK_MILLIS, and millis() fills in
+ * between the ticks.  A converter whose crystal runs a little fast waits at
+ * each tick's worth until the next one turns up, and one that runs a little
+ * slow jumps forward to it, so every converter on the same clock fades at the
+ * same rate.  It never goes backwards.  If the clock stops, it holds for up to
+ * SYNC_TIMEOUT_MILLIS and then carries on from millis().
+ * 
+ * @return The current value of the fade clock, in milliseconds.
+ */
+uint32_t get_fade_clock() {
+#ifdef SYNC_MIDI_CLOCK
+  uint32_t elapsed = millis() - sync_tick_local_millis;
+  
+  if (elapsed > SYNC_TIMEOUT_MILLIS) {
+    elapsed -= SYNC_TIMEOUT_MILLIS - SYNC_TICK_MILLIS;
+  } else if (elapsed > SYNC_TICK_MILLIS) {
+    elapsed = SYNC_TICK_MILLIS;
+  }
+  return sync_tick_clock + elapsed;
+#else
+  return millis();
+#endif
+}
+
+/**
+ * Get the fade clock value for a fade to start at.  With the MIDI clock coming
+ * in, this is the last tick, so every converter that got the command between
+ * the same two ticks starts its fade at the same point, and finishes it
+ * together with the others.
+ * 
+ * @return The fade clock value to start at.
+ */
+uint32_t get_fade_start_clock() {
+#ifdef SYNC_MIDI_CLOCK
+  if (millis() - sync_tick_local_millis <= SYNC_TIMEOUT_MILLIS) {
+    return sync_tick_clock;
+  }
+#endif
+  return get_fade_clock();
+}
+
+#ifdef SYNC_MIDI_CLOCK
+/**
+ * A MIDI clock tick has come in (or, on the sync master, been sent).  If the
+ * clock has been stopped for a while, the fade clock has carried on without
+ * it, so the ticks carry on from there.
+ */
+void sync_clock_tick() {
+  uint32_t clock = get_fade_clock();
+  
+  sync_tick_clock += SYNC_TICK_MILLIS;
+  if ((int32_t)(clock - sync_tick_clock) > 0) {
+    sync_tick_clock = clock;
+  }
+  sync_tick_local_millis = millis();
+}
+
+/**
+ * A MIDI clock tick from one of the inputs.  The sync master makes its own
+ * clock, so it ignores anyone else's.
+ */
+void receive_sync_tick() {
+#ifndef SYNC_MASTER
+  sync_clock_tick();
+#endif
+}
+
+#ifdef SYNC_MASTER
+/**
+ * Send the next MIDI clock tick, if it's due.  This is called once per pass
+ * through the loop, which is never more than a few milliseconds.
+ */
+void run_sync_master() {
+  uint32_t now = millis();
+  
+  if ((int32_t)(now - sync_next_tick_millis) < 0) return;
+  
+  send_serial_midi(MIDI_TIMING_CLOCK);
+  sync_clock_tick();
+  sync_next_tick_millis += SYNC_TICK_MILLIS;
+  if ((int32_t)(now - sync_next_tick_millis) >= 0) {
+    sync_next_tick_millis = now + SYNC_TICK_MILLIS;
+  }
+}
+#endif
+#endif
+
+/**
+ * The only substantial difference between the USB MIDI endpoint code and the
+ * serial MIDI code is reading the MIDI messages.  These read each MIDI message,
+ * decode it into a midi_command structure, and queue it up for use.  Both can
+ * be built in at once, and receive_midi_commands() reads from each in turn.
+ */
+#ifdef USE_USB_MIDI
+/**
+ * The USB MIDI code is a bit simpler, as a full command will come as a block
+ * from the PluggableUSB library.  We receive a midiEventPacket_t with the full
+ * command, and can simply parse this - there's no possibility of a midstream
+ * serial sync issue, and the command is either read or not.
+ */
+midi_command get_usb_midi_command(const midiEventPacket_t rx) {
+  midi_command ret = {0, 0, 0, 0};
+  
+  // Only packets starting with a status byte can be commands - the rest are
+  // the middle of a SysEx, and of no interest.
+  if (!(rx.byte1 & 0x80)) {
+    return ret;
+  }
+  
+  return decode_midi_command(rx.byte1, rx.byte2, rx.byte3);
+}
+
+#ifdef USE_SYSEX
+/**
+ * SysEx messages come in over several USB packets.  The only ones of interest
+ * are a few bytes long, so this only keeps the first few bytes after the start,
+ * and anything longer is ignored.  sysex_length is 0xff when not in a SysEx
+ * message that is being kept.
+ */
+#define SYSEX_BUFFER_SIZE 4
+byte sysex_buffer[SYSEX_BUFFER_SIZE];
+byte sysex_length = 0xff;
+
+// SysEx bytes being sent out, and how many there are, to go in the next packet.
+byte sysex_out[3];
+byte sysex_out_count = 0;
+
+/**
+ * The reply to a request from the host, as it goes out.  The replies are longer
+ * than the USB send buffer, and MidiUSB.sendMIDI() waits (for up to 250ms a
+ * packet) for room, so a host that isn't reading would hold up the loop and the
+ * fader.  Instead, the reply goes out a part at a time, over as many passes of
+ * the loop as it takes, and each part only once there's room for all of it.
+ * 
+ * sysex_reply is the request being answered (SYSEX_READ_COUNTERS or
+ * SYSEX_READ_CAPTURE), or SYSEX_NO_REPLY, and sysex_reply_part is the next part
+ * to send.  Each part is at most 12 bytes, which with the bytes left over from
+ * the last part is at most SYSEX_REPLY_PART_PACKETS packets.  Nothing else is
+ * sent while a reply is going out, as SysEx messages can't be mixed together.
+ */
+#define SYSEX_NO_REPLY 0
+#define SYSEX_REPLY_PART_PACKETS 5
+byte sysex_reply = SYSEX_NO_REPLY;
+byte sysex_reply_part = 0;
+
+/**
+ * Add a byte to the SysEx message being sent, sending out a packet as each one
+ * fills up.
+ */
+void send_sysex_byte(const byte value) {
+  sysex_out[sysex_out_count++] = value;
+  
+  if (sysex_out_count == 3) {
+    send_usb_midi({USB_MIDI_SYSEX_START, sysex_out[0], sysex_out[1],
+            sysex_out[2]});
+    sysex_out_count = 0;
+  }
+}
+
+/**
+ * Finish the SysEx message being sent, and send it on its way.  The last packet
+ * says how many of its bytes are used.
+ */
+void end_sysex() {
+  sysex_out[sysex_out_count++] = SYSEX_END;
+  sysex_out[1] = (sysex_out_count > 1) ? sysex_out[1] : 0;
+  sysex_out[2] = (sysex_out_count > 2) ? sysex_out[2] : 0;
+  send_usb_midi({(byte)(USB_MIDI_SYSEX_START + sysex_out_count),
+          sysex_out[0], sysex_out[1], sysex_out[2]});
+  sysex_out_count = 0;
+  flush_usb_midi();
+}
+
+/**
+ * SysEx data bytes can only be 0-127, so each value is sent as 7 bits at a
+ * time, lowest bits first.
+ * 
+ * @param value The value to send.
+ * @param length The number of 7 bit bytes to send it in.
+ */
+void send_sysex_value(uint32_t value, const byte length) {
+  for (byte i = 0; i < length; i++) {
+    send_sysex_byte(value & 0x7f);
+    value >>= 7;
+  }
+}
+
+#ifdef PERF_COUNTERS
+static_assert(PERF_LATENCY_BUCKETS % 2 == 0,
+        "The latency histogram is sent two buckets at a time");
+
+/**
+ * Send a part of the performance counters reply.  The reply is:
+ * 
+ * F0 7D 01, then the loop count, chain count, and longest poll gap, then the
+ * total and longest time for each stage (commands, chain, fader, EEPROM), each
+ * as 5 bytes.  Then the invalid message, dropped command, and queue full
+ * counts, and the 8 latency histogram buckets, each as 3 bytes.  Then the
+ * time from power up to the DMX output starting, as 5 bytes.  Then F7.
+ * 
+ * All the times are in microseconds.  The counters carry on between the parts,
+ * so each one is as it was when its part went out.
+ * 
+ * @param part The part to send, from 0.
+ * @return True if that was the last part.
+ */
+bool send_perf_counters_part(const byte part) {
+  byte stage = part - 2;
+  byte bucket = (part - 3 - PERF_STAGE_COUNT) * 2;
+  
+  if (part == 0) {
+    send_sysex_byte(SYSEX_START);
+    send_sysex_byte(SYSEX_ID_NON_COMMERCIAL);
+    send_sysex_byte(SYSEX_READ_COUNTERS);
+    send_sysex_value(perf.loop_count, 5);
+  } else if (part == 1) {
+    send_sysex_value(perf.chain_count, 5);
+    send_sysex_value(perf.poll_gap_max, 5);
+  } else if (stage < PERF_STAGE_COUNT) {
+    send_sysex_value(perf.stages[stage].total_micros, 5);
+    send_sysex_value(perf.stages[stage].max_micros, 5);
+  } else if (stage == PERF_STAGE_COUNT) {
+    send_sysex_value(perf.invalid_messages, 3);
+    send_sysex_value(perf.dropped_commands, 3);
+    send_sysex_value(perf.queue_full, 3);
+  } else if (bucket < PERF_LATENCY_BUCKETS) {
+    send_sysex_value(perf.latency_histogram[bucket], 3);
+    send_sysex_value(perf.latency_histogram[bucket + 1], 3);
+  } else {
+    send_sysex_value(dmx_start_micros, 5);
+    end_sysex();
+    return true;
+  }
+  
+  flush_usb_midi();
+  return false;
+}
+#endif
+
+#ifdef MIDI_CAPTURE
+// The capture entries in the reply going out: the queue position of the oldest
+// one, and how many there are, as they were when the host asked.
+byte midi_capture_reply_position = 0;
+byte midi_capture_reply_count = 0;
+
+/**
+ * Send a part of the MIDI capture reply.  The reply is:
+ * 
+ * F0 7D 03, then the number of commands, then each command from the oldest to
+ * the newest: the command code, MIDI channel, and the two data bytes, 4 bytes
+ * for the micros() timestamp it came in at (the bottom 28 bits), and 3 bytes
+ * for the fade delay.  Then F7.
+ * 
+ * Each command is a part of its own.  The commands that were captured when the
+ * host asked are the ones sent, but one that comes in while the reply is going
+ * out can take the place of an old one that hasn't been sent yet.
+ * 
+ * @param part The part to send, from 0.
+ * @return True if that was the last part.
+ */
+bool send_midi_capture_part(const byte part) {
+  if (part == 0) {
+    send_sysex_byte(SYSEX_START);
+    send_sysex_byte(SYSEX_ID_NON_COMMERCIAL);
+    send_sysex_byte(SYSEX_READ_CAPTURE);
+    send_sysex_byte(midi_capture_reply_count);
+  } else if (part <= midi_capture_reply_count) {
+    midi_capture_entry *entry = &midi_capture[
+            (byte)(midi_capture_reply_position + part - 1) &
+            (MIDI_CAPTURE_SIZE - 1)];
+    send_sysex_byte(entry->command.command);
+    send_sysex_byte(entry->command.channel);
+    send_sysex_byte(entry->command.data0);
+    send_sysex_byte(entry->command.data1);
+    send_sysex_value(entry->received_micros, 4);
+    send_sysex_value(entry->fade_delay_micros, 3);
+  } else {
+    end_sysex();
+    return true;
+  }
+  
+  flush_usb_midi();
+  return false;
+}
+
+/**
+ * Note that the command being run has staged a fade.  The delay is filled in
+ * when the fade actually starts.
+ */
+void capture_fade_staged() {
+  if (midi_capture_running == MIDI_CAPTURE_NONE) return;
+  
+  midi_capture[midi_capture_running].fade_delay_micros = MIDI_CAPTURE_STAGED;
+}
+
+/**
+ * Note that the staged fades have started, for every command that staged one.
+ */
+void capture_staged_fades_started() {
+  uint32_t now = micros();
+  
+  for (byte i = 0; i < MIDI_CAPTURE_SIZE; i++) {
+    midi_capture_entry *entry = &midi_capture[i];
+    if (entry->fade_delay_micros != MIDI_CAPTURE_STAGED) continue;
+    
+    uint32_t delay = now - entry->received_micros;
+    entry->fade_delay_micros = (delay < MIDI_CAPTURE_STAGED) ? delay :
+            MIDI_CAPTURE_STAGED - 1;
+  }
+}
+#endif
+
+#ifdef TELEMETRY
+/**
+ * Work out how far through its fade a timeline is, in 7 bits.  The step is the
+ * fraction of the fade covered in each millisecond (scaled to 32 bits), so the
+ * top 7 bits of the product are the progress.
+ * 
+ * @param timeline The running timeline.
+ * @param now The current value of the fade clock.
+ * @return How far through the fade it is, 0-127.
+ */
+byte get_fade_progress(const byte timeline, const uint32_t now) {
+  uint32_t elapsed = now - fade_timelines[timeline].start_millis;
+  
+  if (elapsed >= fade_timelines[timeline].duration_millis) {
+    return 127;
+  }
+  return (fade_timelines[timeline].position_step * elapsed) >> 25;
+}
+
+/**
+ * Work out the telemetry flags: whether anything is fading, and whether every
+ * finished channel has been written to the EEPROM.
+ */
+byte get_telemetry_flags() {
+  byte flags = fade_timeline_mask ? TELEMETRY_FADE_ACTIVE : 0;
+  bool dirty = false;
+  
+  for (byte i = 0; i < CHANNEL_BITMAP_SIZE; i++) {
+    dirty |= eeprom_dirty_bitmap[i];
+  }
+  if (!dirty && !eeprom_log.type) {
+    flags |= TELEMETRY_EEPROM_COMMITTED;
+  }
+  return flags;
+}
+
+/**
+ * Send the state that has changed back to the host.  The message is:
+ * 
+ * F0 7D 06, then the flags (1 for a fade running, 2 for the EEPROM being up to
+ * date), then the running fade timelines as a 2 byte bitmask, and how far
+ * through each running one is (0-127), lowest timeline first.  Then the number
+ * of channels, and each channel's DMX channel as 3 bytes (the masters are
+ * 0xff00 up) and value as 2 bytes.  Then F7.
+ * 
+ * The channel values are before the masters, as the masters themselves are
+ * among the channels sent.
+ * 
+ * @param now The current value of millis().
+ */
+void send_telemetry(const uint32_t now) {
+  byte count = 0;
+  
+  send_sysex_byte(SYSEX_START);
+  send_sysex_byte(SYSEX_ID_NON_COMMERCIAL);
+  send_sysex_byte(SYSEX_TELEMETRY);
+  send_sysex_byte(telemetry_flags);
+  send_sysex_value(telemetry_fade_mask, 2);
+  for (byte t = 0; t < MAX_FADE_TIMELINES; t++) {
+    if (telemetry_fade_mask & (1 << t)) {
+      send_sysex_byte(telemetry_fade_progress[t]);
+    }
+  }
+  
+  for (byte i = 0; i < CHANNEL_BITMAP_SIZE; i++) {
+    for (byte bits = telemetry_dirty_bitmap[i]; bits; bits &= bits - 1) {
+      count++;
+    }
+  }
+  if (count > TELEMETRY_MAX_CHANNELS) {
+    count = TELEMETRY_MAX_CHANNELS;
+  }
+  send_sysex_byte(count);
+  
+  for (byte entry = 0; count; entry++) {
+    byte mask = 1 << (entry & 0x7);
+    if (!(telemetry_dirty_bitmap[entry >> 3] & mask)) continue;
+    
+    telemetry_dirty_bitmap[entry >> 3] &= ~mask;
+    send_sysex_value(channel_addresses[entry], 3);
+    send_sysex_value(channel_values[entry], 2);
+    count--;
+  }
+  
+  end_sysex();
+  telemetry_sent_millis = now;
+}
+
+/**
+ * Send the telemetry if anything has changed, it's been long enough since the
+ * last message, no reply is going out, and the USB send buffer has room for
+ * it.  This is called once per pass through the loop, after the fader.  A
+ * message that doesn't fit is not worked out at all, and the changes carry over
+ * to the next pass.
+ */
+void run_telemetry() {
+  if (!telemetry_enabled) return;
+  
+  uint32_t now = millis();
+  uint32_t clock = get_fade_clock();
+  if (now - telemetry_sent_millis < TELEMETRY_INTERVAL_MILLIS) return;
+  if (sysex_reply != SYSEX_NO_REPLY) return;
+  if (usb_midi_send_space() < TELEMETRY_MAX_PACKETS) return;
+  
+  byte flags = get_telemetry_flags();
+  bool changed = (flags != telemetry_flags) ||
+          (fade_timeline_mask != telemetry_fade_mask);
+  
+  telemetry_flags = flags;
+  telemetry_fade_mask = fade_timeline_mask;
+  for (byte t = 0; t < MAX_FADE_TIMELINES; t++) {
+    if (!(fade_timeline_mask & (1 << t))) continue;
+    
+    byte progress = get_fade_progress(t, clock);
+    changed |= (progress != telemetry_fade_progress[t]);
+    telemetry_fade_progress[t] = progress;
+  }
+  for (byte i = 0; i < CHANNEL_BITMAP_SIZE; i++) {
+    changed |= telemetry_dirty_bitmap[i];
+  }
+  
+  if (changed) {
+    send_telemetry(now);
+  }
+}
+
+/**
+ * Turn the telemetry stream on or off.  Turning it on sends everything, so the
+ * host starts with the full state.
+ * 
+ * @param enabled True to start the stream, or false to stop it.
+ */
+void set_telemetry(const bool enabled) {
+  telemetry_enabled = enabled;
+  if (!enabled) return;
+  
+  for (byte entry = 0; entry < channel_entry_count; entry++) {
+    telemetry_dirty_bitmap[entry >> 3] |= 1 << (entry & 0x7);
+  }
+  telemetry_flags = 0xff;
+  telemetry_sent_millis = millis() - TELEMETRY_INTERVAL_MILLIS;
+}
+#endif
+
+/**
+ * Start replying to a request from the host.  If there's already a reply going
+ * out, the request is ignored - the host gets the one it asked for first.
+ * 
+ * @param request The request (SYSEX_READ_COUNTERS or SYSEX_READ_CAPTURE).
+ */
+void start_sysex_reply(const byte request) {
+  if (sysex_reply != SYSEX_NO_REPLY) return;
+  
+  sysex_reply = request;
+  sysex_reply_part = 0;
+#ifdef MIDI_CAPTURE
+  midi_capture_reply_position = midi_queue_head - midi_capture_count;
+  midi_capture_reply_count = midi_capture_count;
+#endif
+}
+
+/**
+ * Send as much of the reply going out as there's room for in the USB send
+ * buffer, without waiting for the host.  This is called once per pass through
+ * the loop, after the fader.
+ */
+void run_sysex_reply() {
+  while (sysex_reply != SYSEX_NO_REPLY &&
+          usb_midi_send_space() >= SYSEX_REPLY_PART_PACKETS) {
+    bool done = false;
+    
+#ifdef PERF_COUNTERS
+    if (sysex_reply == SYSEX_READ_COUNTERS) {
+      done = send_perf_counters_part(sysex_reply_part);
+    }
+#endif
+#ifdef MIDI_CAPTURE
+    if (sysex_reply == SYSEX_READ_CAPTURE) {
+      done = send_midi_capture_part(sysex_reply_part);
+    }
+#endif
+    sysex_reply_part++;
+    if (done) {
+      sysex_reply = SYSEX_NO_REPLY;
+    }
+  }
+}
+
+/**
+ * Run a complete SysEx message.  The requests are F0 7D 01 F7 to read the
+ * performance counters, F0 7D 02 F7 to reset them, F0 7D 03 F7 to read the
+ * MIDI capture, and F0 7D 04 F7 and F0 7D 05 F7 to start and stop the
+ * telemetry.
+ */
+void process_sysex() {
+  if (sysex_length != 2 || sysex_buffer[0] != SYSEX_ID_NON_COMMERCIAL) {
+    return;
+  }
+  
+#ifdef PERF_COUNTERS
+  if (sysex_buffer[1] == SYSEX_READ_COUNTERS) {
+    start_sysex_reply(SYSEX_READ_COUNTERS);
+  } else if (sysex_buffer[1] == SYSEX_RESET_COUNTERS) {
+    memset(&perf, 0, sizeof(perf));
+  }
+#endif
+#ifdef MIDI_CAPTURE
+  if (sysex_buffer[1] == SYSEX_READ_CAPTURE) {
+    start_sysex_reply(SYSEX_READ_CAPTURE);
+  }
+#endif
+#ifdef TELEMETRY
+  if (sysex_buffer[1] == SYSEX_START_TELEMETRY) {
+    set_telemetry(true);
+  } else if (sysex_buffer[1] == SYSEX_STOP_TELEMETRY) {
+    set_telemetry(false);
+  }
+#endif
+}
+
+/**
+ * Collect the bytes of a SysEx packet, and run the message once the end of it
+ * turns up.
+ */
+void receive_sysex_packet(const midiEventPacket_t rx) {
+  byte data[3] = {rx.byte1, rx.byte2, rx.byte3};
+  byte count = 3;
+  
+  if ((rx.header & 0xf) != USB_MIDI_SYSEX_START) {
+    count = (rx.header & 0xf) - USB_MIDI_SYSEX_START;
+  }
+  
+  for (byte i = 0; i < count; i++) {
+    if (data[i] == SYSEX_START) {
+      sysex_length = 0;
+    } else if (data[i] == SYSEX_END) {
+      process_sysex();
+      sysex_length = 0xff;
+    } else if (sysex_length < SYSEX_BUFFER_SIZE) {
+      sysex_buffer[sysex_length++] = data[i];
+    } else {
+      // Too long to be one of ours, or not part of a message being kept.
+      sysex_length = 0xff;
+    }
+  }
+}
+#endif
+
+/**
+ * Read every packet waiting on the USB interface in one go, and queue up the
+ * commands, so a burst of commands from Proclaim doesn't back up the endpoint
+ * while they're run one at a time.  This stops when there are no more
+ * packets, or the limit is reached.
+ * 
+ * @param limit The most commands to queue.  There must be room for them.
+ * @return The number of commands queued.
+ */
+byte receive_usb_midi_commands(const byte limit) {
+  byte received = 0;
+  midiEventPacket_t rx;
+  
+  while (received < limit) {
+    // If there is no packet to be read, the header is zero.
+    rx = read_usb_midi();
+    if (!rx.header) {
+      break;
+    }
+    
+#ifdef USE_SYSEX
+    // SysEx packets are requests for the converter, not lighting commands.
+    if ((rx.header & 0xf) >= USB_MIDI_SYSEX_START &&
+            (rx.header & 0xf) <= USB_MIDI_SYSEX_END_3) {
+      receive_sysex_packet(rx);
+      continue;
+    }
+#endif
+#ifdef SYNC_MIDI_CLOCK
+    if (rx.byte1 == MIDI_TIMING_CLOCK) {
+      receive_sync_tick();
+      continue;
+    }
+#endif
+    
+    midi_command command = get_usb_midi_command(rx);
+    if (command.command) {
+      push_midi_command(command);
+      received++;
+    }
+  }
+  
+  return received;
+}
+#endif
+
+#ifdef USE_SERIAL_MIDI
+/**
+ * The serial MIDI reader is a bit more complex, as the message comes in a byte
+ * at a time, and it has to handle the possibility of mid-stream sync.  It never
+ * waits for a byte to turn up - the state of the message being read is kept
+ * between calls, and the message is finished when the rest of it arrives.
+ * 
+ * serial_running_status is the status byte of the current message, or zero if
+ * the data bytes coming in are of no interest (mid-stream, or SysEx and other
+ * system messages).  It stays set after the message is done, as MIDI allows
+ * sending more messages of the same type as just the data bytes ("running
+ * status"), saving a third of the bytes on the wire.
+ */
+byte serial_running_status = 0;
+byte serial_data[2];
+byte serial_data_count = 0;
+
+/**
+ * Process one byte from the serial port.
+ * 
+ * @return The command, once a full message has been read.  Until then, the
+ *   command is zero.
+ */
+midi_command get_serial_midi_command() {
+  midi_command ret = {0, 0, 0, 0};
+  byte val = read_serial_midi();
+  
+  // Real time messages (clock, start, stop, etc) are a single byte, and can
+  // turn up anywhere - even in the middle of another message.  They don't
+  // change anything about the message being read, so just skip them (after
+  // passing the clock on to the sync).
+  if (val >= 0xf8) {
+#ifdef SYNC_MIDI_CLOCK
+    if (val == MIDI_TIMING_CLOCK) {
+      receive_sync_tick();
+    }
+#endif
+    return ret;
+  }
+  
+  // A byte with the high bit set is the start of a new message.  Channel
+  // messages set the running status, and anything else (SysEx and the other
+  // system messages) clears it, so their data gets skipped.
+  if (val & 0x80) {
+    serial_running_status = (val < 0xf0) ? val : 0;
+    serial_data_count = 0;
+    return ret;
+  }
+  
+  // Data without a status to go with it - we're mid-stream, or in a message
+  // that isn't of interest.  Skip it.
+  if (!serial_running_status) {
+    return ret;
+  }
+  
+  serial_data[serial_data_count++] = val;
+  
+  // Program change and channel pressure only have one data byte.  Everything
+  // else has two (Note and Velocity).
+  if ((serial_running_status & 0xe0) == 0xc0) {
+    serial_data[1] = 0;
+  } else if (serial_data_count < 2) {
+    return ret;
+  }
+  
+  // Message done.  The next data byte starts another one with the same status.
+  serial_data_count = 0;
+  return decode_midi_command(serial_running_status, serial_data[0],
+          serial_data[1]);
+}
+
+/**
+ * Read the bytes waiting on the serial port, and queue up any commands.  This
+ * stops when there are no more bytes, or the limit is reached - anything left
+ * waits in the serial buffer until the next call.
+ * 
+ * @param limit The most commands to queue.  There must be room for them.
+ * @return The number of commands queued.
+ */
+byte receive_serial_midi_commands(const byte limit) {
+  byte received = 0;
+  
+  while (received < limit && serial_midi_available()) {
+    midi_command command = get_serial_midi_command();
+    if (command.command) {
+      push_midi_command(command);
+      received++;
+    }
+  }
+  
+  return received;
+}
+#endif
+
+/**
+ * Read and queue up commands from all the MIDI inputs.  Each input can only
+ * queue its share of the queue on each call, and the queue is always empty
+ * when this is called (the loop runs everything before reading more), so each
+ * one always has room, and a burst on one input is spread over a few calls
+ * rather than making the other wait.  Commands from the two are run in the
+ * order they are read, and a chain can mix them.
+ * 
+ * @return The number of commands queued.
+ */
+byte receive_midi_commands() {
+  byte received = 0;
+  
+#ifdef USE_USB_MIDI
+  received += receive_usb_midi_commands(MIDI_INPUT_QUEUE_SHARE);
+#endif
+#ifdef USE_SERIAL_MIDI
+  received += receive_serial_midi_commands(MIDI_INPUT_QUEUE_SHARE);
+#endif
+  
+  if (!midi_queue_space()) {
+    PERF_COUNT(queue_full);
+  }
+  return received;
+}
+
+/**
+ * Data bytes in MIDI can only be 0-127.  However, DMX brightness values are
+ * 0-255.  This function scales the 0-127 value to a full range 0-255 value.
+ * 
+ * Really, it doubles it and adds 1 if it's 127.
+ */
+uint8_t scale_brightness(const uint8_t brightness) {
+  if (brightness == 127) {
+    return 255;
+  }
+  return brightness * 2;
+}
+
+/**
+ * Queue a channel to have its value stored to EEPROM.
+ * 
+ * @param entry The channel entry that has a new settled value.
+ */
+void mark_channel_for_eeprom(const byte entry) {
+  eeprom_dirty_bitmap[entry >> 3] |= 1 << (entry & 0x7);
+}
+
+/**
+ * Dim a value by a master level.  255 leaves the value alone, and 0 is off.
+ * This is a single 8x8 multiply, so there's no division in the output.
+ * 
+ * @param value The channel value.
+ * @param level The master level.
+ * @return The dimmed value.
+ */
+byte apply_master(const byte value, const byte level) {
+  return ((uint16_t)value * (level + 1)) >> 8;
+}
+
+/**
+ * Dim a 16-bit value by a master level, the same way.
+ * 
+ * @param value The 16-bit channel value.
+ * @param level The master level.
+ * @return The dimmed value.
+ */
+uint16_t apply_master_16(const uint16_t value, const byte level) {
+  return ((uint32_t)value * (level + 1)) >> 8;
+}
+
+/**
+ * Write a 16-bit dimmer out to the DMX array, dimming the coarse and fine
+ * channels together as one value.
+ * 
+ * @param entry The coarse channel entry.
+ * @param fine The fine channel entry.
+ */
+void write_channel_output_16(const byte entry, const byte fine) {
+  uint16_t address = channel_addresses[entry];
+  uint16_t value = ((uint16_t)channel_values[entry] << 8) |
+          channel_values[fine];
+  byte masters = channel_masters[entry];
+  byte submaster = masters & CHANNEL_SUBMASTER_MASK;
+  
+  if (!(masters & CHANNEL_NO_GRAND_MASTER)) {
+    value = apply_master_16(value,
+            channel_values[master_entry_base + GRAND_MASTER]);
+  }
+  if (submaster) {
+    value = apply_master_16(value,
+            channel_values[master_entry_base + submaster]);
+  }
+  dmxBuffer[address - 1] = value >> 8;
+  dmxBuffer[address] = value & 0xff;
+}
+
+/**
+ * Write a channel's current value out to the DMX array, through the grand
+ * master and its submaster.  The masters themselves don't go out, and the fine
+ * channels go out with their coarse channels.
+ * 
+ * @param entry The channel entry.
+ */
+void write_channel_output(const byte entry) {
+  uint16_t address = channel_addresses[entry];
+  byte value = channel_values[entry];
+  byte masters = channel_masters[entry];
+  byte submaster = masters & CHANNEL_SUBMASTER_MASK;
+  byte fine;
+  
+  if (address >= MASTER_ADDRESS_BASE || is_fine_channel_entry(entry)) return;
+  
+  fine = get_fine_channel_entry(entry);
+  if (fine != NO_CHANNEL_ENTRY) {
+    write_channel_output_16(entry, fine);
+    return;
+  }
+  
+  if (!(masters & CHANNEL_NO_GRAND_MASTER)) {
+    value = apply_master(value,
+            channel_values[master_entry_base + GRAND_MASTER]);
+  }
+  if (submaster) {
+    value = apply_master(value, channel_values[master_entry_base + submaster]);
+  }
+  dmxBuffer[address - 1] = value;
+}
+
+/**
+ * Write every channel out again.  This is only needed when a master changes,
+ * or after restoring everything at power on.
+ */
+void refresh_channel_outputs() {
+  for (byte entry = 0; entry < channel_entry_count; entry++) {
+    write_channel_output(entry);
+  }
+  masters_changed = false;
+}
+
+/**
+ * Set the current value of a channel, and write it out.  If it's a master, all
+ * the channels get written out again at the end of the fader pass.  A fine
+ * channel is written out when its coarse channel is set, so set it first.
+ * 
+ * @param entry The channel entry.
+ * @param value The new current value.
+ */
+void set_channel_value(const byte entry, const byte value) {
+#ifdef TELEMETRY
+  if (channel_values[entry] != value) {
+    telemetry_dirty_bitmap[entry >> 3] |= 1 << (entry & 0x7);
+  }
+#endif
+  channel_values[entry] = value;
+  if (channel_addresses[entry] >= MASTER_ADDRESS_BASE) {
+    masters_changed = true;
+  } else {
+    write_channel_output(entry);
+  }
+}
+
+/**
+ * Add a channel to the active channel list as pending, waiting for the next
+ * call to set_fade() to start it moving.
+ * 
+ * A channel that is not in the list is not fading, so the current value is
+ * already the start value.  A channel that is already in the list may be
+ * partway through a fade, so the new fade starts from the current value, and it
+ * is held there until the new fade starts.
+ * 
+ * @param changed The channel entry whose target value has been changed.
+ */
+void mark_channel_active(const byte changed) {
+  // A 16-bit dimmer fades as one, on its coarse channel.
+  byte entry = is_fine_channel_entry(changed) ? changed - 1 : changed;
+  byte fine = get_fine_channel_entry(entry);
+  byte mask = 1 << (entry & 0x7);
+  
+  if (active_channel_bitmap[entry >> 3] & mask) {
+    for (byte i = 0; i < active_channel_count; i++) {
+      if (active_channels[i] == entry) {
+        active_channel_timelines[i] = FADE_PENDING;
+        break;
+      }
+    }
+    fade_start_values[entry] = channel_values[entry];
+    if (fine != NO_CHANNEL_ENTRY) {
+      fade_start_values[fine] = channel_values[fine];
+    }
+    return;
+  }
+  
+  active_channel_bitmap[entry >> 3] |= mask;
+  active_channels[active_channel_count] = entry;
+  active_channel_timelines[active_channel_count] = FADE_PENDING;
+  active_channel_count++;
+}
+
+/**
+ * Finish the fade on the channel at the given position in the active channel
+ * list: write out the target value, and drop it from the list.  The last entry
+ * is moved into the freed position, so don't advance past it when iterating.
+ * 
+ * @param index The position in active_channels of the channel to finish.
+ */
+void finish_active_channel(const byte index) {
+  byte entry = active_channels[index];
+  byte fine = get_fine_channel_entry(entry);
+  
+  if (fine != NO_CHANNEL_ENTRY) {
+    set_channel_value(fine, fade_target_values[fine]);
+    fade_start_values[fine] = fade_target_values[fine];
+    mark_channel_for_eeprom(fine);
+  }
+  set_channel_value(entry, fade_target_values[entry]);
+  fade_start_values[entry] = fade_target_values[entry];
+  mark_channel_for_eeprom(entry);
+  
+  active_channel_bitmap[entry >> 3] &= ~(1 << (entry & 0x7));
+  active_channel_count--;
+  active_channels[index] = active_channels[active_channel_count];
+  active_channel_timelines[index] = 
+          active_channel_timelines[active_channel_count];
+}
+
+/**
+ * Set a layer's value for a channel.  The channel becomes the latest set by
+ * this layer, and is queued up for compose_layers() to work out its new target.
+ * 
+ * @param layer The layer, as defined in layers.h.
+ * @param entry The channel entry.
+ * @param value The value for the channel on this layer.
+ */
+void set_layer_value(const byte layer, const byte entry, const byte value) {
+  layer_values[layer][entry] = value;
+  channel_layers[entry] |= 1 << layer;
+  channel_latest_layer[entry] = layer;
+  layer_dirty_bitmap[layer][entry >> 3] |= 1 << (entry & 0x7);
+}
+
+/**
+ * Release all the channels held by a layer.  For the LTP channels that this
+ * layer set last, the highest layer still holding the channel takes over.
+ * 
+ * @param layer The layer, as defined in layers.h.
+ */
+void release_layer(const byte layer) {
+  for (byte entry = 0; entry < channel_entry_count; entry++) {
+    if (!(channel_layers[entry] & (1 << layer))) continue;
+    
+    channel_layers[entry] &= ~(1 << layer);
+    if (channel_latest_layer[entry] == layer) {
+      for (byte below = LAYER_COUNT; below--; ) {
+        if (channel_layers[entry] & (1 << below)) {
+          channel_latest_layer[entry] = below;
+          break;
+        }
+      }
+    }
+    layer_dirty_bitmap[layer][entry >> 3] |= 1 << (entry & 0x7);
+  }
+}
+
+/**
+ * Work out the value a channel should have from its layers.  A channel that no
+ * layer is holding is off.
+ * 
+ * @param entry The channel entry.
+ * @return The target value for the channel.
+ */
+byte compose_channel(const byte entry) {
+  byte layers = channel_layers[entry];
+  byte value = 0;
+  
+  if (!layers) return 0;
+  
+  if (!(htp_bitmap[entry >> 3] & (1 << (entry & 0x7)))) {
+    return layer_values[channel_latest_layer[entry]][entry];
+  }
+  
+  for (byte layer = 0; layer < LAYER_COUNT; layer++) {
+    if ((layers & (1 << layer)) && layer_values[layer][entry] > value) {
+      value = layer_values[layer][entry];
+    }
+  }
+  return value;
+}
+
+/**
+ * Work out the new targets for the channels that any layer has changed, and
+ * put the ones that have actually changed on the active list, waiting for the
+ * next call to set_fade().
+ * 
+ * @return True if any channel has a new target.
+ */
+bool compose_layers() {
+  bool changed = false;
+  
+  for (byte i = 0; i < CHANNEL_BITMAP_SIZE; i++) {
+    byte dirty = 0;
+    for (byte layer = 0; layer < LAYER_COUNT; layer++) {
+      dirty |= layer_dirty_bitmap[layer][i];
+      layer_dirty_bitmap[layer][i] = 0;
+    }
+    
+    for (byte bit = 0; dirty; bit++, dirty >>= 1) {
+      if (!(dirty & 1)) continue;
+      
+      byte entry = (i << 3) | bit;
+      byte value = compose_channel(entry);
+      if (value != fade_target_values[entry]) {
+        fade_target_values[entry] = value;
+        mark_channel_active(entry);
+        changed = true;
+      }
+    }
+  }
+  
+  return changed;
+}
+
+/**
+ * Find a free fade timeline.  If all of them are in use, the one closest to
+ * finishing is ended early by snapping its channels to their targets - with
+ * this many fades going at once, nobody is going to notice.
+ * 
+ * @param now The current value of the fade clock.
+ * @return The index of a timeline that no channel is using.
+ */
+byte allocate_fade_timeline(const uint32_t now) {
+  byte timeline = 0;
+  uint32_t shortest_remaining = 0xffffffff;
+  
+  for (byte i = 0; i < MAX_FADE_TIMELINES; i++) {
+    if (!(fade_timeline_mask & (1 << i))) {
+      return i;
+    }
+    
+    uint32_t elapsed = now - fade_timelines[i].start_millis;
+    uint32_t remaining = 0;
+    if (elapsed < fade_timelines[i].duration_millis) {
+      remaining = fade_timelines[i].duration_millis - elapsed;
+    }
+    if (remaining < shortest_remaining) {
+      shortest_remaining = remaining;
+      timeline = i;
+    }
+  }
+  
+  for (byte i = 0; i < active_channel_count; ) {
+    if (active_channel_timelines[i] == timeline) {
+      finish_active_channel(i);
+    } else {
+      i++;
+    }
+  }
+  
+  return timeline;
+}
+
+/**
+ * Set how long a fade timeline runs for.  This is where the one and only
+ * division for the fade happens: the step is the fraction of the fade (scaled
+ * to 32 bits) covered in each millisecond, so the fader can work out the fade
+ * position with a multiply.  A zero length fade is over as soon as it starts,
+ * so it doesn't need a step.
+ * 
+ * @param timeline The timeline to set up.
+ * @param duration_millis How long the fade runs for.
+ */
+void set_fade_timeline_duration(const byte timeline,
+        const uint32_t duration_millis) {
+  fade_timelines[timeline].duration_millis = duration_millis;
+  fade_timelines[timeline].position_step = duration_millis ?
+          0xffffffff / duration_millis : 0;
+}
+
+/**
+ * Work out how long a fade runs for from the fade time sent in a command.
+ * Normally, this is simply the number of seconds.
+ * 
+ * With FAST_FADE_TIMES, the fade time is a tiny floating point number, so the
+ * short fades can be set finely and the long ones still fit in 0-127.  The top
+ * 3 bits are the exponent, and the bottom 4 are the mantissa, in tenths of a
+ * second.  Each group of 16 values covers twice the time of the one before, in
+ * steps twice the size:
+ * 
+ *     0-15: 0-1.5s in 0.1s steps (5 is a 0.5s bump)
+ *    16-31: 1.6-3.1s in 0.1s steps
+ *    32-47: 3.2-6.2s in 0.2s steps
+ *    48-63: 6.4-12.4s in 0.4s steps
+ *    64-79: 12.8-24.8s in 0.8s steps
+ *    80-95: 25.6-49.6s in 1.6s steps
+ *   96-111: 51.2-99.2s in 3.2s steps
+ *  112-127: 102.4-198.4s in 6.4s steps
+ * 
+ * Working it out is just a shift, so there's no table to look it up in.
+ * 
+ * @param fade_time The fade time from the command (0-127).
+ * @return The fade time in milliseconds.
+ */
+uint32_t get_fade_millis(const byte fade_time) {
+#ifdef FAST_FADE_TIMES
+  byte exponent = fade_time >> 4;
+  uint32_t tenths = fade_time & 0xf;
+  
+  if (exponent) {
+    tenths = (tenths + 16) << (exponent - 1);
+  }
+  return tenths * (MS_PER_SECOND / 10);
+#else
+  return (uint32_t)fade_time * MS_PER_SECOND;
+#endif
+}
+
+/**
+ * Find the timeline already staged in this chain for a fade time and curve.
+ * 
+ * @param fade_millis The fade time in milliseconds.
+ * @param curve The fade curve, as defined in fade_curves.h.
+ * @return The index of the staged timeline, or FADE_PENDING if there isn't one.
+ */
+byte find_staged_fade_timeline(const uint32_t fade_millis, const byte curve) {
+  for (byte i = 0; i < MAX_FADE_TIMELINES; i++) {
+    if ((fade_staged_mask & (1 << i)) &&
+            fade_timelines[i].duration_millis == fade_millis &&
+            fade_timelines[i].curve == curve) {
+      return i;
+    }
+  }
+  return FADE_PENDING;
+}
+
+/**
+ * Set the fade parameters.  This stages a fade timeline with the requested
+ * length and curve, and puts all the pending channels (the ones that have had
+ * their targets changed since the last fade was started) on it.  If another
+ * command in this chain has already staged one with the same length and curve,
+ * they share it.  The fade starts when start_staged_fades() is called at the
+ * end of the chain.  If the fade time is zero, the new values are set without
+ * any fade.
+ * 
+ * Channels that are already fading on another timeline carry on unchanged, so
+ * a short fade started in the middle of a long one doesn't stretch it out.
+ * 
+ * Each channel is queued to be stored to EEPROM as its fade completes, for
+ * restoration on powerup.
+ * 
+ * @param fade_millis The fade time in milliseconds.
+ * @param curve The fade curve, as defined in fade_curves.h.
+ */
+void set_fade(const uint32_t fade_millis, const byte curve) {
+  uint32_t now = get_fade_clock();
+  byte timeline = FADE_PENDING;
+  
+  for (byte i = 0; i < active_channel_count; i++) {
+    if (active_channel_timelines[i] != FADE_PENDING) continue;
+    
+    // Only claim a timeline if something is actually going to use it.
+    if (timeline == FADE_PENDING) {
+      timeline = find_staged_fade_timeline(fade_millis, curve);
+      if (timeline == FADE_PENDING) {
+        timeline = allocate_fade_timeline(now);
+        fade_timelines[timeline].start_millis = now;
+        set_fade_timeline_duration(timeline, fade_millis);
+        fade_timelines[timeline].curve = curve;
+        fade_timeline_mask |= 1 << timeline;
+        fade_staged_mask |= 1 << timeline;
+      }
+#ifdef MIDI_CAPTURE
+      capture_fade_staged();
+#endif
+    }
+    active_channel_timelines[i] = timeline;
+  }
+}
+
+/**
+ * Start all the fades staged by the chain at once.  This is called just before
+ * the fader runs, so it never sees a staged timeline.
+ */
+void start_staged_fades() {
+  if (!fade_staged_mask) return;
+  
+  uint32_t now = get_fade_start_clock();
+  for (byte i = 0; i < MAX_FADE_TIMELINES; i++) {
+    if (fade_staged_mask & (1 << i)) {
+      fade_timelines[i].start_millis = now;
+    }
+  }
+  fade_staged_mask = 0;
+#ifdef MIDI_CAPTURE
+  capture_staged_fades_started();
+#endif
+}
+
+/**
+ * Set a new scene with a fade time.  This pulls a scene out of scene.h, sets it
+ * on the scene layer, sets the fade timers properly, and then returns to let
+ * the fader run through things.  It will write all values in the scene to the
+ * layer, so the scene becomes the latest for all its channels, but only the
+ * channels whose targets change get faded.
+ * 
+ * However, it now won't call for a fade if the same scene is called for.
+ * 
+ * @param scene The scene index from scene.h
+ * @param fade_millis The fade time in milliseconds.
+ * @param curve The fade curve, as defined in fade_curves.h.
+ */
+void set_scene_with_fade_millis(const byte scene, const uint32_t fade_millis,
+        const byte curve) {
+  byte row;
+  
+  // Don't read invalid scenes in.
+  if (scene >= MAX_SCENE_COUNT) return;
+  
+  // Look up which of the stored scene rows this scene uses.
+  row = pgm_read_byte_near(&scene_index[scene]);
+  
+  // Each scene slot is the channel entry of the same number.
+  for (byte i = 0; i < MAX_UNIQUE_CHANNELS; i++) {
+    set_layer_value(LAYER_SCENE, i, pgm_read_byte_near(&scene_rows[row][i]));
+  }
+
+  // If anything has changed in the targets, run the fade.
+  if (compose_layers()) {
+    set_fade(fade_millis, curve);
+  }
+}
+
+/**
+ * Set a new scene with the fade time from a scene command.
+ * 
+ * @param scene The scene index from scene.h
+ * @param fade_time The fade time, as sent in the command.
+ * @param curve The fade curve, as defined in fade_curves.h.
+ */
+void set_scene_with_fade_time(const byte scene, const byte fade_time,
+        const byte curve) {
+  set_scene_with_fade_millis(scene, get_fade_millis(fade_time), curve);
+}
+
+/**
+ * Work out the value for each kind of channel a fixture might have, from the
+ * color or brightness in a fixture command (see fixture_profiles in fixtures.h
+ * for how).  A fixture with a dimmer as well as its colors has the dimmer at
+ * full for any color but off, as the color channels set the color.  The fine
+ * dimmer channel repeats the coarse one, so a 16-bit brightness goes from 0 to
+ * 65535, just like the 8-bit ones go from 0 to 255.
+ * 
+ * @param profile The profile of the fixture's type.
+ * @param color_brightness The color or brightness from the fixture command.
+ * @param emitters The values, indexed by the EMITTER_ defines in fixtures.h.
+ * @return False if the color isn't in the colors list.
+ */
+bool get_fixture_emitters(const fixture_profile *profile,
+        const byte color_brightness, byte *emitters) {
+  byte red, green, blue, white = 0, amber = 0;
+  byte kinds = 0;
+  
+  for (byte channel = 0; channel < profile->channel_count; channel++) {
+    kinds |= 1 << profile->layout[channel];
+  }
+  
+  // No color channels - this is a white light, so simply set the brightness.
+  if (!(kinds & (1 << EMITTER_RED))) {
+    emitters[EMITTER_DIMMER] = scale_brightness(color_brightness);
+    emitters[EMITTER_DIMMER_FINE] = emitters[EMITTER_DIMMER];
+    return true;
+  }
+  
+  if (color_brightness >= MAX_FIXTURE_COLOR) {
+    return false;
+  }
+  
+  // Read the color value out of program memory, and split off the white and
+  // amber parts of it for the fixtures that have them.
+  red = pgm_read_byte_near(&colors[color_brightness][0]);
+  green = pgm_read_byte_near(&colors[color_brightness][1]);
+  blue = pgm_read_byte_near(&colors[color_brightness][2]);
+  if (kinds & (1 << EMITTER_WHITE)) {
+    white = red < green ? red : green;
+    white = white < blue ? white : blue;
+    red -= white;
+    green -= white;
+    blue -= white;
+  }
+  if (kinds & (1 << EMITTER_AMBER)) {
+    amber = (green >= 128 || red < green * 2) ? red : green * 2;
+    red -= amber;
+    green -= amber >> 1;
+  }
+  
+  emitters[EMITTER_RED] = red;
+  emitters[EMITTER_GREEN] = green;
+  emitters[EMITTER_BLUE] = blue;
+  emitters[EMITTER_WHITE] = white;
+  emitters[EMITTER_AMBER] = amber;
+  emitters[EMITTER_DIMMER] = (red | green | blue | white | amber) ? 255 : 0;
+  emitters[EMITTER_DIMMER_FINE] = emitters[EMITTER_DIMMER];
+  return true;
+}
 
 /**
- * Basic hash function that chews the above compile_date string into a one byte
- * hash.  Read out of program memory, xor the byte in, move on.  This is in NO
- * way cryptographically secure or anything else, it's just unlikely to be the
- * same value for two builds, with a useful enough probability.
+ * Set a fixture to a new value, on the fixture layer.  The fade is staged like
+ * any other (see set_fade()): it starts when the command chain is over, on the
+ * same timeline as the other fades in the chain with the same time and curve,
+ * and a later command with a different fade time gets a timeline of its own
+ * rather than changing this one.
  * 
- * @return A byte that is a basic hash of the compile date.
+ * @param fixture The fixture (0-15) to use - sent in as the channel value.
+ * @param color_brightness The color value to use, as defined in fixtures.h - 
+ *   sent as the note.  For a fixture without color channels, this sets the
+ *   brightness directly with a reasonable scale factor.
+ * @param fade_time The fade time - sent in as velocity.
  */
-byte get_build_hash() {
-  byte xor_stamp = 0;
-
-  for (byte i = 0; i < strlen_P(compile_date); i++) {
-    byte val = pgm_read_byte_near(compile_date + i);
-    xor_stamp ^= val;
-  }
+void set_fixture_with_fade_time(const byte fixture, const byte color_brightness, 
+        const byte fade_time) {
+  byte channel, entry;
+  byte emitters[EMITTER_COUNT];
+  fixture_data fixture_values;
+  fixture_profile profile;
+  
+  // Shouldn't happen, but there's no data up this high...
+  if (fixture >= MAX_FIXTURE_COUNT) return;
 
-  return xor_stamp;
-}
+  // Copy the fixture values and its type's profile from program memory into
+  // SRAM for use.
+  memcpy_P(&fixture_values, &fixtures[fixture], sizeof(fixture_data));
+  memcpy_P(&profile,
+          &fixture_profiles[FIXTURE_TYPE_INDEX(fixture_values.fixture_type)],
+          sizeof(fixture_profile));
 
-/**
- * Print the state, if enabled.  This is useful for debugging without a full
- * set of lights.
- */
-#ifdef PRINT_STATE
-void print_state() {
-  Serial.println(F("====Current Channel State===="));
-  for (uint8_t i = 0; i < MAX_UNIQUE_CHANNELS; i++) {
-    Serial.print(F("["));
-    Serial.print(pgm_read_byte_near(&scene_slot_to_channel_mapping[i]));
-    Serial.print(F("]: "));
-    Serial.println(dmxBuffer[pgm_read_byte_near(&scene_slot_to_channel_mapping[i]) - 1]);
+  if (fixture_values.fixture_type == FIXTURE_UNUSED ||
+          !get_fixture_emitters(&profile, color_brightness, emitters)) {
+    PERF_COUNT(dropped_commands);
+    return;
+  }
+  
+  // Valid fixture - set each channel to the value for what it does.
+  for (channel = 0; channel < profile.channel_count; channel++) {
+    entry = find_channel_entry(fixture_values.fixture_base_address + channel);
+    set_layer_value(LAYER_FIXTURE, entry, emitters[profile.layout[channel]]);
   }
+  
+  // For every type, request a fade of the desired length.  The MIDI channel is
+  // already used to pick the fixture, so fixture fades are always linear.
+  compose_layers();
+  set_fade(get_fade_millis(fade_time), FADE_CURVE_LINEAR);
 }
-#endif
 
 /**
- * On power on, attempt to restore the settings from EEPROM.  This only happens
- * if the compile magic matches.  This will write the current state array, the
- * future state field, and the DMX array (extern hack).  Call this BEFORE
- * calling any of the DMX functions that will start sending out the data to the
- * lights.
- * 
- * Byte 0 of the EEPROM stores the build magic, and bytes 1-127 store the DMX
- * channel values at the end of each fade.
- * 
- * If the data does not match, this zeroes the EEPROM state and returns false.
+ * Fade a master to a new level.
  * 
- * @return True if the data was restored, false if the magic does not match.
+ * @param master The master (0 for the grand master, or the submaster) - sent
+ *   in as the number.
+ * @param level The new level, scaled like the other brightness values - sent
+ *   in as the value.
  */
-bool restore_from_eeprom() {
-  byte build_hash = get_build_hash();
+void set_master(const byte master, const byte level) {
+  byte entry = master_entry_base + master;
   
-  if (build_hash == EEPROM[0]) {
-    // Build hash matches - restore the state to all the various fields.
-    for (byte i = 1; i < MAX_DMX_CHANNELS; i++) {
-      byte val = EEPROM[i];
-      fade_start_values[i] = val;
-      fade_target_values[i] = val;
-      dmxBuffer[i] = val;
-    }
-  } else {
-    // Hashes do not match.  Store the new build hash and zero all channels.
-    EEPROM[0] = build_hash;
-    for (byte i = 1; i < MAX_DMX_CHANNELS; i++) {
-      EEPROM[i] = 0;
-      fade_start_values[i] = 0;
-      fade_target_values[i] = 0;
-      dmxBuffer[i] = 0;
-    }
-    
-    // Ensure this gets written out when the fader next runs.
-    fade_start_millis = fade_end_millis = millis();
+  if (master >= MASTER_COUNT) {
+    PERF_COUNT(dropped_commands);
+    return;
   }
+  
+  fade_target_values[entry] = scale_brightness(level);
+  mark_channel_active(entry);
+  set_fade(MASTER_FADE_MILLIS, FADE_CURVE_LINEAR);
 }
 
 /**
- * The only substantial difference between the USB MIDI endpoint code and the
- * serial MIDI code is this function.  This reads the MIDI command and packs it
- * into a midi_command structure for return and use.
+ * Scale a chase step time by the chase rate.  This divides, but only once per
+ * step, not once per frame.
+ * 
+ * @param tenths The time from chases.h, in tenths of a second.
+ * @return The time at the running chase's rate, in milliseconds.
  */
-#ifdef USE_USB_MIDI
+uint32_t scale_chase_time(const uint16_t tenths) {
+  return ((uint32_t)tenths * (MS_PER_SECOND / 10) * CHASE_RATE_NORMAL) /
+          running_chase.rate;
+}
+
 /**
- * The USB MIDI code is a bit simpler, as a full command will come as a block
- * from the PluggableUSB library.  We receive a midiEventPacket_t with the full
- * command, and can simply parse this - there's no possibility of a midstream
- * serial sync issue, and the command is either read or not.
+ * Start the current step of the running chase: fade to its scene, and work out
+ * when the next step starts.
+ * 
+ * @param now The value of millis() the step starts at.
  */
-midi_command get_midi_command() {
-  midi_command ret = {0, 0, 0, 0};
-  byte command;
-  midiEventPacket_t rx;
-
-  // Read a packet from the USB interface.  If there is no packet to be read,
-  // all the values of the return structure are zeroed.
-  rx = MidiUSB.read();
+void start_chase_step(const uint32_t now) {
+  chase_data chase;
+  chase_step step;
+  uint32_t fade_millis;
   
-  // If there is no MIDI data, there can be no MIDI command.
-  if (!rx.header) {
-    return ret;
-  }
- 
-  // A MIDI command code has the hight bit set, 3 bits of command code, and the
-  // lower 4 are the channel.  Mask this out to see what the command is.
-  command = rx.byte1 & MIDI_COMMAND_MASK;
+  memcpy_P(&chase, &chases[running_chase.chase], sizeof(chase_data));
+  memcpy_P(&step, &chase.steps[running_chase.step], sizeof(chase_step));
   
-  if (command == MIDI_NOTE_ON) {
-    ret.command = COMMAND_SCENE;
-  } else if (command == MIDI_NOTE_OFF) {
-    ret.command = COMMAND_FIXTURE;
-  } else if (command == MIDI_CONTROL_CHANGE) {
-    ret.command = COMMAND_CHANNEL;
-  } else {
-    // Not a valid command, leave command as null to indicate nothing.
-    // However, read out the data bytes and the command value.
+  fade_millis = scale_chase_time(step.fade_tenths);
+  running_chase.step_start_millis = now;
+  running_chase.step_millis = fade_millis + scale_chase_time(step.hold_tenths);
+  set_scene_with_fade_millis(step.scene, fade_millis, running_chase.curve);
+}
+
+/**
+ * Start, stop, or change the speed of a chase.
+ * 
+ * @param chase The chase from chases.h - sent in as the note.
+ * @param rate The speed, where CHASE_RATE_NORMAL is the times in chases.h, and
+ *   0 stops the chase - sent in as the pressure.
+ * @param curve The fade curve, as defined in fade_curves.h.
+ */
+void set_chase(const byte chase, const byte rate, const byte curve) {
+  if (!rate || chase >= CHASE_COUNT) {
+    running_chase.chase = NO_CHASE;
+    return;
   }
   
-  // MIDI channels are 1-16, not 0-15.  However, everything is 0 indexed in C.
-  ret.channel = (rx.byte1 & 0xf);
+  running_chase.rate = rate;
+  running_chase.curve = curve;
+  if (chase == running_chase.chase) return;
   
-  // Copy the two data bytes: Note and Velocity.
-  ret.data0 = rx.byte2;
-  ret.data1 = rx.byte3;
-
-  return ret;
+  running_chase.chase = chase;
+  running_chase.step = 0;
+  start_chase_step(get_fade_start_clock());
 }
 
-#else
 /**
- * The serial MIDI reader is a bit more complex, as it has to handle the
- * possibility of mid-stream sync and has to wait for the data byes to be ready
- * to read.
+ * Move the running chase on to the next step, if it's time.  Each step starts
+ * exactly one step time after the last one did, rather than whenever this gets
+ * called, so the chase doesn't drift.  If it's fallen more than a whole step
+ * behind (the speed was just turned up a lot), it carries on from now instead.
  */
-midi_command get_midi_command() {
-  midi_command ret = {0, 0, 0, 0};
-  byte val, command, data;
-  
-  // If there is no serial data, there can be no MIDI command - return the null
-  // struct (valid not set).
-  if (!Serial.available()) {
-    return ret;
-  }
-
-  // Wait for a command - this is a byte with the high bit set.  If this is NOT
-  // set, we're mid-stream - just return and try again next time.
-  val = Serial.read();
-  if (!(val & 0x80)) {
-    return ret;
-  }
+void run_chase() {
+  uint32_t now = get_fade_clock();
+  uint32_t next_step_millis;
+  byte step_count;
   
-  // Determine if this is a command of interest.  Mask off the upper bit and the
-  // lower 8, then compare with the valid command values.
-  command = val & MIDI_COMMAND_MASK;
+  if (running_chase.chase == NO_CHASE) return;
+  if (now - running_chase.step_start_millis < running_chase.step_millis) return;
   
-  if (command == MIDI_NOTE_ON) {
-    ret.command = COMMAND_SCENE;
-  } else if (command == MIDI_NOTE_OFF) {
-    ret.command = COMMAND_FIXTURE;
-  } else if (command == MIDI_CONTROL_CHANGE) {
-    ret.command = COMMAND_CHANNEL;
-  } else {
-    // Not a valid command, leave command as null to indicate nothing.
-    // However, read out the data bytes and the command value.
+  next_step_millis = running_chase.step_start_millis +
+          running_chase.step_millis;
+  if (now - next_step_millis >= running_chase.step_millis) {
+    next_step_millis = now;
   }
   
-  // MIDI channels are 1-16, not 0-15.  However, everything is 0 indexed in C.
-  ret.channel = (val & 0xf);
-  
-  // Read the two data bytes: Note and Velocity.
-  while (!Serial.available());
-  ret.data0 = Serial.read(); // Note
-  while (!Serial.available());
-  ret.data1 = Serial.read(); // Velocity
-
-  return ret;
+  step_count = pgm_read_byte_near(&chases[running_chase.chase].step_count);
+  running_chase.step++;
+  if (running_chase.step >= step_count) {
+    running_chase.step = 0;
+  }
+  start_chase_step(next_step_millis);
 }
-#endif
 
 /**
- * Data bytes in MIDI can only be 0-127.  However, DMX brightness values are
- * 0-255.  This function scales the 0-127 value to a full range 0-255 value.
+ * Take the lowest numbered channel entry out of the EEPROM dirty bitmap.
  * 
- * Really, it doubles it and adds 1 if it's 127.
+ * @return The channel entry, or NO_CHANNEL_ENTRY if nothing is waiting to be
+ *   stored.
  */
-uint8_t scale_brightness(const uint8_t brightness) {
-  if (brightness == 127) {
-    return 255;
+byte take_eeprom_dirty_channel() {
+  for (byte i = 0; i < CHANNEL_BITMAP_SIZE; i++) {
+    if (eeprom_dirty_bitmap[i]) {
+      byte bit = 0;
+      while (!(eeprom_dirty_bitmap[i] & (1 << bit))) bit++;
+      eeprom_dirty_bitmap[i] &= ~(1 << bit);
+      return (i << 3) | bit;
+    }
   }
-  return brightness * 2;
+  return NO_CHANNEL_ENTRY;
 }
 
 /**
- * Set the fade parameters.  This notes the start time and desired end time, and
- * non-zero values in these indicate that a fade needs to run.  If both the
- * start and end values are identical, the new value is set without any fade.
- * 
- * If a fade is already running, this will copy the current fade values to the
- * start array, and extend the fade.  This should work reasonably well for most
- * use cases.
- * 
- * This also marks that the scene needs to be stored to EEPROM after completion
- * for restoration on powerup.
+ * Start a new record at the head of the EEPROM log.  If the head has moved into
+ * the other half of the EEPROM from the newest snapshot (or there isn't one),
+ * this is a snapshot of every channel entry, which makes all the queued
+ * channels redundant.  Otherwise, it's a delta record of as many of the queued
+ * channels as will fit.
  */
-void set_fade(const uint8_t fade_seconds) {
-  // This needs to be reset for the new fade.
-  fade_start_millis = millis();  
+void start_eeprom_record() {
+  byte half = eeprom_log.head >= (eeprom_length() / 2);
   
-  // Case: Fade running.
-  if (fade_end_millis && fade_start_millis) {
-    // Copy current state to the start.
-    for (int i = 0; i < MAX_DMX_CHANNELS; i++) {
-      fade_start_values[i] = fade_current_values[i];
+  if (half != eeprom_log.snapshot_half) {
+    eeprom_log.type = EEPROM_RECORD_SNAPSHOT;
+    eeprom_log.count = channel_entry_count;
+    eeprom_log.snapshot_half = half;
+    memset(eeprom_dirty_bitmap, 0, sizeof(eeprom_dirty_bitmap));
+  } else {
+    byte count = 0;
+    for (byte i = 0; i < CHANNEL_BITMAP_SIZE; i++) {
+      for (byte bits = eeprom_dirty_bitmap[i]; bits; bits &= bits - 1) {
+        count++;
+      }
     }
-
-    // Just stretch the fade.
-    fade_end_millis = fade_end_millis + (fade_seconds * MS_PER_SECOND);
-  } 
-  // Case: No fade running, start a new one.
-  else {
-    fade_end_millis = fade_start_millis + (fade_seconds * MS_PER_SECOND);
+    if (count > EEPROM_MAX_DELTA_ENTRIES) {
+      count = EEPROM_MAX_DELTA_ENTRIES;
+    }
+    eeprom_log.type = EEPROM_RECORD_DELTA;
+    eeprom_log.count = count;
   }
   
-  scene_is_stored_to_eeprom = 0;
+  eeprom_log.length = (eeprom_log.type == EEPROM_RECORD_SNAPSHOT) ?
+          EEPROM_SNAPSHOT_SIZE(eeprom_log.count) :
+          EEPROM_RECORD_SIZE(eeprom_log.count);
+  eeprom_log.index = 0;
+  eeprom_log.part = 0;
+  eeprom_log.crc = EEPROM_CRC_SEED;
 }
 
 /**
- * Set a new scene with a fade time.  This pulls a scene out of scene.h, sets it
- * in the fade_target_values array, sets the fade timers properly, and then
- * returns to let the fader run through things.  It will write all values in the
- * scene to the target_values array, as the fader only updates values that don't
- * match already for performance reasons.
+ * Work out the next byte of the record being written.  The channel values are
+ * read as each byte is written, so a channel that finishes another fade partway
+ * through the record is either written with its new value, or is still queued
+ * for the next record.
  * 
- * However, it now won't call for a fade if the same scene is called for.
+ * The snapshot fingerprint and entries are written out in order, and the delta
+ * entries are taken from the dirty bitmap one at a time.
  * 
- * @param scene The scene index from scene.h
+ * @return The byte to write at eeprom_log.index in the record.
  */
-void set_scene_with_fade_time(const byte scene, const byte fade_seconds) {
-  byte channel, value;
-  byte fade_required = false;
+byte next_eeprom_record_byte() {
+  uint16_t index = eeprom_log.index;
+  byte value;
   
-  // Don't read invalid scenes in.
-  if (scene >= MAX_SCENE_COUNT) return;
+  if (index == eeprom_log.length - 1) {
+    return eeprom_log.crc;
+  }
   
-  for (byte i = 0; i < MAX_UNIQUE_CHANNELS; i++) {
-    channel = pgm_read_byte_near(&scene_slot_to_channel_mapping[i]);
-    value = pgm_read_byte_near(&scenes[scene][i]);
-    if (value != fade_target_values[channel]) {
-      fade_required = true;
+  if (index == 0) {
+    value = eeprom_log.type;
+  } else if (index == 1) {
+    value = eeprom_log.sequence & 0xff;
+  } else if (index == 2) {
+    value = eeprom_log.sequence >> 8;
+  } else if (index == 3) {
+    value = eeprom_log.count;
+  } else if (eeprom_log.type == EEPROM_RECORD_SNAPSHOT &&
+          index < EEPROM_RECORD_HEADER_SIZE + EEPROM_FINGERPRINT_SIZE) {
+    value = LAYOUT_FINGERPRINT >> (8 * (index - EEPROM_RECORD_HEADER_SIZE));
+  } else {
+    if (eeprom_log.part == 0) {
+      if (eeprom_log.type == EEPROM_RECORD_DELTA) {
+        eeprom_log.entry = take_eeprom_dirty_channel();
+      } else if (index ==
+              EEPROM_RECORD_HEADER_SIZE + EEPROM_FINGERPRINT_SIZE) {
+        eeprom_log.entry = 0;
+      } else {
+        eeprom_log.entry++;
+      }
+      value = channel_addresses[eeprom_log.entry] & 0xff;
+    } else if (eeprom_log.part == 1) {
+      value = channel_addresses[eeprom_log.entry] >> 8;
+    } else {
+      value = fade_start_values[eeprom_log.entry];
     }
-    fade_target_values[channel] = value;
-  }
-
-  // If anything has changed in the targets, run the fade.
-  if (fade_required) {
-    set_fade(fade_seconds);
+    eeprom_log.part = (eeprom_log.part == EEPROM_ENTRY_SIZE - 1) ? 0 :
+            eeprom_log.part + 1;
   }
+  
+  eeprom_log.crc = crc8_update(eeprom_log.crc, value);
+  return value;
 }
 
 /**
- * Set a fixture to a new value.  The fade time may be reset by subsequent calls
- * but they should be close enough together to avoid any visual artifacts with
- * the transitions.  Hopefully.
+ * After a fade, store the updated scene values.  This appends the values of
+ * the channels that have finished fading to the EEPROM log for restoration on
+ * the next powerup.  EEPROM writes are slow (about 3.5ms per write), so even a
+ * small record takes a while to write out.
  * 
- * @param fixture The fixture (0-15) to use - sent in as the channel value.
- * @param color_brightness The color value to use, as defined in fixtures.h - 
- *   sent as the note.  For a white fixture, this sets the brightness directly
- *   with a reasonable scale factor.
- * @param fade_seconds The fade time in seconds - sent in as velocity.
+ * Waiting on a whole record's worth of writes holds up the main loop long
+ * enough to notice, so this is called once per pass through the loop and
+ * writes out at most one byte.  If the last write is still in progress, this
+ * returns without waiting for it.
  */
-void set_fixture_with_fade_time(const byte fixture, const byte color_brightness, 
-        const byte fade_seconds) {
-  byte channel, value;
-  fixture_data fixture_values;
-  
-  // Shouldn't happen, but there's no data up this high...
-  if (fixture >= MAX_FIXTURE_COUNT) return;
-
-  // Copy the fixture values from program memory into SRAM for use.
-  memcpy_P(&fixture_values, &fixtures[fixture], sizeof(fixture_data));
-
-  if (fixture_values.fixture_type == FIXTURE_UNUSED) return;
+void store_current_to_eeprom() {
+  if (!eeprom_write_done()) return;
   
-  // Valid fixture - set the values.
-  if (fixture_values.fixture_type == FIXTURE_RGB) {
-    // RGB fixture - set the RGB channels to the desired color.
-    if (color_brightness >= MAX_FIXTURE_COLOR) return;
-    
-    // Read the color value out of program memory and set it.
-    for (channel = 0; channel < 3; channel++) {
-      value = pgm_read_byte_near(&colors[color_brightness][channel]);
-      fade_target_values[fixture_values.fixture_base_address + channel] = value;
+  if (!eeprom_log.type) {
+    bool dirty = false;
+    for (byte i = 0; i < CHANNEL_BITMAP_SIZE; i++) {
+      dirty |= eeprom_dirty_bitmap[i];
     }
-  } else if (fixture_values.fixture_type == FIXTURE_WHITE) {
-    // This is a white light - simply set the brightness.
-    fade_target_values[fixture_values.fixture_base_address] = 
-            scale_brightness(color_brightness);
+    
+    // Nothing to do, unless the log needs a first snapshot.
+    if (!dirty && eeprom_log.snapshot_half != EEPROM_NO_SNAPSHOT) return;
+    
+    start_eeprom_record();
   }
   
-  // For both types, request a fade of the desired length.
-  set_fade(fade_seconds);
+  update_eeprom(eeprom_log.head + eeprom_log.index, next_eeprom_record_byte());
+  eeprom_log.index++;
+  
+  // Record done - move the head past it.
+  if (eeprom_log.index == eeprom_log.length) {
+    eeprom_log.head = next_eeprom_record_offset(eeprom_log.head +
+            eeprom_log.length);
+    eeprom_log.sequence++;
+    eeprom_log.type = 0;
+  }
 }
 
 /**
- * At the end of a fade, store the updated scene values.  This writes out the
- * current values to EEPROM for restoration on the next powerup, but it only
- * writes the values that have actually changed.  EEPROM writes are slow (about
- * 3.5ms per write), so writing all 128 values takes half a second, for no good
- * reason except wearing out the EEPROM.  It is well worth the read access to
- * skip unneeded writes.
+ * Reshape the position through a fade with a fade curve.  The top byte of the
+ * position picks the entry in the curve table, and the bottom byte is used to
+ * smooth between it and the next one.  The last entry has nothing after it, so
+ * it's smoothed up to the top of the fade.
+ * 
+ * @param curve The fade curve, as defined in fade_curves.h.
+ * @param position The linear position through the fade, 0-65535.
+ * @return The curved position through the fade, 0-65535.
  */
-void store_current_to_eeprom() {
-  if (!scene_is_stored_to_eeprom) {
-    for (byte i = 1; i < MAX_DMX_CHANNELS; i++) {
-      if (fade_start_values[i] != EEPROM[i]) {
-        EEPROM[i] = fade_start_values[i];
-      }
-    }
-    scene_is_stored_to_eeprom = 1;
+uint16_t apply_fade_curve(const byte curve, const uint16_t position) {
+  byte index = position >> 8;
+  uint16_t low, high;
+  
+  if (curve == FADE_CURVE_LINEAR) {
+    return position;
   }
+  
+  low = pgm_read_byte_near(&fade_curves[curve - 1][index]);
+  high = (index == 255) ? 256 :
+          pgm_read_byte_near(&fade_curves[curve - 1][index + 1]);
+  
+  return (low << 8) + (high - low) * (position & 0xff);
 }
 
 /**
  * Fun with faders...
  * 
- * If the fade_start_millis/fade_end_millis values are not zero, this means a
- * fade is in progress.  This function will, without using floating point math,
- * calculate the value for all the channels that differ between the start and
- * end values, and write the fade values.  Once the fade is over, this will
- * update the start scene with the current scene, null out the fader values, and
- * then write the scene to the EEPROM for restoration on powerup.
+ * If any bits in fade_timeline_mask are set, this means a fade is in progress.
+ * This function will, without using floating point math, work out how far
+ * through each running timeline the fade is, then calculate the value for all
+ * the channels in the active channel list, and write the fade values.  As each
+ * channel reaches the end of its fade, it's set to the target value, taken out
+ * of the list, and queued to be written to the EEPROM for restoration on
+ * powerup.
  * 
  * There is simply no good reason to use floating point math for an Arduino
  * sketch that is writing integer values out, and adding the floating point
- * emulation libraries adds an awful lot of code bulk (a few kb).
+ * emulation libraries adds an awful lot of code bulk (a few kb).  Division is
+ * nearly as bad - the AVR has no hardware divide, so each one is hundreds of
+ * cycles.  The fade position comes from a multiply by the step that was worked
+ * out when the fade started, and each channel is a multiply and a shift.  Fade
+ * curves are a table read per timeline, not per channel.
  */
 void run_fader() {
-  // If neither value is set, there's no fade in progress.  Return.
-  if (!(fade_start_millis || fade_end_millis)) {
+  uint16_t fade_position[MAX_FADE_TIMELINES];
+  byte timelines_done = 0;
+  byte timelines_in_use = 0;
+  uint32_t now = get_fade_clock();
+  
+  // If no timelines are running, there's no fade in progress.  Return.
+  if (!fade_timeline_mask) {
     return;
   }
   
-  // If the fade is done, set all values to their target values, terminate the
-  // fade, and write the state to eeprom.  This also handles zero second fades
-  // where start and end time are the same (it will simply write out all the
-  // new values as this will happen after the zero second fade request).
-  if (millis() >= fade_end_millis) {
+  // Calculate how far through each running fade we are in millis.  The
+  // position through the fade ranges from 0-65535 (scaled), and the step never
+  // takes it past the top before the fade is done.  This also handles zero
+  // second fades, which are done immediately.
+  for (byte t = 0; t < MAX_FADE_TIMELINES; t++) {
+    if (!(fade_timeline_mask & (1 << t))) continue;
     
-    // Write out the full target value and copy it into the start array.
-    for (byte i = 0; i < MAX_DMX_CHANNELS; i++) {
-      DmxMaster.write(i, fade_target_values[i]);
-      fade_start_values[i] = fade_target_values[i];
-    }
+    // This /should/ be wraparound safe...
+    uint32_t fade_time_elapsed = now - fade_timelines[t].start_millis;
     
-    // With the fade completed, indicate that no fade is in progress.
-    fade_start_millis = 0;
-    fade_end_millis = 0;
-
-    store_current_to_eeprom();
-
-    return;
+    if (fade_time_elapsed >= fade_timelines[t].duration_millis) {
+      timelines_done |= 1 << t;
+    } else {
+      fade_position[t] = apply_fade_curve(fade_timelines[t].curve,
+              (fade_timelines[t].position_step * fade_time_elapsed) >> 16);
+    }
   }
-  
-  // Fade is needed!  Calculate how far through the fade we are in millis, and
-  // do the correct math to determine the correct value for each DMX channel.
-  uint32_t total_fade_time = fade_end_millis - fade_start_millis;
-  
-  // This /should/ be wraparound safe...
-  uint32_t fade_time_elapsed = millis() - fade_start_millis;
-
-  // Percent through the fade ranges from 0-256 (scaled).
-  uint32_t fade_percent = (256 * fade_time_elapsed) / total_fade_time;
 
-  for (byte i = 0; i < MAX_DMX_CHANNELS; i++) {
-    byte old_value, new_value, value;
+  for (byte i = 0; i < active_channel_count; ) {
+    byte entry, fine, timeline;
+    uint16_t old_value, new_value, value;
     int32_t temp; // INT32 - not UINT.  This needs to handle negative values!
-    old_value = fade_start_values[i];
-    new_value = fade_target_values[i];
-
-    // No point in doing expensive math on things that aren't changing...
-    if (old_value == new_value) {
-      fade_current_values[i] = new_value;
+    entry = active_channels[i];
+    timeline = active_channel_timelines[i];
+    
+    // Pending channels hold their value until their fade is started.
+    if (timeline == FADE_PENDING) {
+      i++;
       continue;
     }
     
+    // A 16-bit dimmer fades its coarse and fine channels as one value.
+    fine = get_fine_channel_entry(entry);
+    old_value = fade_start_values[entry];
+    new_value = fade_target_values[entry];
+    if (fine != NO_CHANNEL_ENTRY) {
+      old_value = (old_value << 8) | fade_start_values[fine];
+      new_value = (new_value << 8) | fade_target_values[fine];
+    }
+    
+    // If the fade is done, or there's nothing to fade, write out the target
+    // value and drop the channel from the list.  The last channel in the list
+    // is moved into this slot, so don't advance.
+    if ((timelines_done & (1 << timeline)) || old_value == new_value) {
+      finish_active_channel(i);
+      continue;
+    }
+    timelines_in_use |= 1 << timeline;
+    
     // Calculate the offset (positive or negative) between old and new.
     temp = (int32_t)new_value - (int32_t)old_value;
     
-    // Convert the percent through the fade into the offset from the old value.
-    temp *= fade_percent;
-    temp /= 256;
+    // Convert the position through the fade into the offset from the old
+    // value.  The shift rounds down, which is close enough for the middle of a
+    // fade - the end of the fade is always exactly the target value.  A 16-bit
+    // offset times the position doesn't fit in 32 bits, so the bottom bit of
+    // the position is dropped for those.
+    if (fine == NO_CHANNEL_ENTRY) {
+      temp *= fade_position[timeline];
+      temp >>= 16;
+    } else {
+      temp *= fade_position[timeline] >> 1;
+      temp >>= 15;
+    }
     
-    // Apply the offset to the old value to get the midpoint channel value.
+    // Apply the offset to the old value to get the midpoint channel value, and
+    // set it.  That keeps it as the current value, if the fade switches
+    // mid-fade, and writes it out through the masters.
     value = old_value + temp;
-
-    // Store the current value to the in-process structure in case the fade
-    // switches mid-fade.
-    fade_current_values[i] = value;
-    
-    DmxMaster.write(i, value);
+    if (fine != NO_CHANNEL_ENTRY) {
+      set_channel_value(fine, value & 0xff);
+      value >>= 8;
+    }
+    set_channel_value(entry, value);
+    i++;
+  }
+  
+  // A master moved, so everything it dims needs writing out again.
+  if (masters_changed) {
+    refresh_channel_outputs();
   }
+  
+  // Any timeline without channels left on it is finished.
+  fade_timeline_mask = timelines_in_use;
 }
 
 void setup() {
-  // Avoid the "double start" issues on older boards.
-  // Probably not needed in production.
-  delay(2000);
-  
-  // Hardware serial is used for the MIDI side - set MIDI baud rate 31.25kHz
-#ifndef USE_USB_MIDI
-  Serial.begin(31250);
-#endif
-
-#ifdef PRINT_STATE
-  Serial.begin(115200);
+#ifdef BOOT_DELAY_MILLIS
+  delay(BOOT_DELAY_MILLIS);
 #endif
   
-  // Check to see if we are restoring from old state, or creating new state.
+  // Get the lights going first: some fixtures black out if they lose the DMX
+  // signal, and a USB bus reset (someone unplugging a mic) restarts the
+  // converter.  Set up the fade state for all the channels in the headers,
+  // then check to see if we are restoring from old state, or creating new
+  // state.
+  setup_channel_entries();
   if (!restore_from_eeprom()) {
     // State does not match, all channels set to 0.  We need to set the fixed
     // channel values.
     // Directly write to the DMX Master array so these are in place before the
     // DMX signals start going out (it shouldn't matter, but why not?)
-    for (int i = 0; i < NUMBER_OF_FIXED_CHANNELS; i++) {
+    for (byte i = 0; i < NUMBER_OF_FIXED_CHANNELS; i++) {
       fixed_channel fixed;
       
       memcpy_P(&fixed, &fixed_channels[i], sizeof(fixed_channel));
       
-      fade_start_values[fixed.channel] = fixed.value;
-      fade_target_values[fixed.channel] = fixed.value;
-      dmxBuffer[fixed.channel] = fixed.value;
+      restore_channel(fixed.channel, fixed.value);
+      mark_channel_for_eeprom(find_channel_entry(fixed.channel));
     }
   }
 
-  // All the buffers hold the proper values now.  Start the DMX output.
-  // Any of the DmxMaster commands will start output, and this code supports
-  // up to 128 channels, so transmit all of them.
-  DmxMaster.maxChannel(128);
+  // All the buffers hold the proper values now.  Write them out through the
+  // masters, and start the DMX output.
+  refresh_channel_outputs();
+  // Set the number of channels to transmit, which starts the output.
+  start_dmx_output(dmx_frame_channels);
+  dmx_output_started = true;
+  restart_frame_timing();
+#ifdef PERF_COUNTERS
+  dmx_start_micros = micros();
+  last_poll_micros = dmx_start_micros;
+#endif
+  
+  // Now the MIDI side.  The USB side is set up by the Arduino core before
+  // this, and carries on by itself, so only the serial port needs starting.
+  // Nothing is read until the loop starts anyway.
+#ifdef USE_SERIAL_MIDI
+  start_serial_midi();
+#endif
+
+#ifdef PRINT_STATE
+  Serial.begin(115200);
+#endif
+}
+
+/**
+ * Note the gap before a command batch that just came in.  Only gaps short
+ * enough to be part of a chain are counted - anything longer is the gap
+ * between two separate cues.
+ * 
+ * @param now The value of micros() when the commands came in.
+ */
+void record_command_gap(const uint32_t now) {
+  uint32_t gap = now - last_command_micros;
+  int32_t error;
+  
+  last_command_micros = now;
+  if (gap >= COMMAND_CHAIN_MAX_MICROS) return;
+  
+  error = (int32_t)gap - (int32_t)(command_gap_average_x8 >> 3);
+  command_gap_average_x8 += error;
+  if (error < 0) error = -error;
+  command_gap_deviation_x4 += error - (int32_t)(command_gap_deviation_x4 >> 2);
+}
+
+/**
+ * How long to wait after a command for the next one in the chain.
+ * 
+ * @return The chain window, in microseconds.
+ */
+uint32_t command_chain_window_micros() {
+  uint32_t window = (command_gap_average_x8 >> 3) + command_gap_deviation_x4;
+  
+  if (window < COMMAND_CHAIN_MIN_MICROS) return COMMAND_CHAIN_MIN_MICROS;
+  if (window > COMMAND_CHAIN_MAX_MICROS) return COMMAND_CHAIN_MAX_MICROS;
+  return window;
+}
+
+/**
+ * Pick the fade curve from the MIDI channel of a command.  Channels past the
+ * last curve are linear, so anything already sent on them doesn't change.
+ * 
+ * @param channel The MIDI channel (0-15) the command came in on.
+ * @return The fade curve, as defined in fade_curves.h.
+ */
+byte get_fade_curve(const byte channel) {
+  if (channel >= FADE_CURVE_COUNT) {
+    return FADE_CURVE_LINEAR;
+  }
+  return channel;
+}
+
+/**
+ * Execute a single MIDI command.
+ * 
+ * Scene mode and fixture mode call the proper function for the update, but the
+ * raw DMX channel mode simply sets the values.
+ * 
+ * @param command The command, from the MIDI queue.
+ */
+void process_midi_command(const midi_command command) {
+  // Data 0 (Note) is the scene ID, Data 1 (Velocity) is the fade time, and the
+  // channel is the fade curve.
+  // A scene command takes over from any running chase.
+  if (command.command == COMMAND_SCENE) {
+    running_chase.chase = NO_CHASE;
+    set_scene_with_fade_time(command.data0, command.data1,
+            get_fade_curve(command.channel));
+    #ifdef PRINT_STATE
+    Serial.print(F("Setting scene: "));
+    Serial.println(command.data0);
+    #endif
+  } 
+  
+  // Channel is the fixture #, data0 (note) is color or brightness, and
+  // data1 (velocity) is the fade time.  Each fixture fades on its own time.
+  else if (command.command == COMMAND_FIXTURE) {
+    set_fixture_with_fade_time(command.channel, command.data0,
+            command.data1);
+  } 
+  
+  // DMX channel mode takes "Number" as the channel and "Value" as the
+  // brightness for that channel (scaled).  To actually set the new values
+  // into motion, send a message with "Number" set to 0 and "Value" set to
+  // the desired fade time, on the channel for the fade curve.  The master
+  // channel (16) is reserved, and isn't raw DMX channel mode at all: "Number"
+  // is the master and "Value" is the level.  See masters.h.
+  else if (command.command == COMMAND_CHANNEL) {
+    if (command.channel == MASTER_MIDI_CHANNEL) {
+      set_master(command.data0, command.data1);
+    } else if (command.data0 == 0) {
+      compose_layers();
+      set_fade(get_fade_millis(command.data1),
+              get_fade_curve(command.channel));
+    } else {
+      // Channels that aren't in the headers get an entry from the raw channel
+      // pool.  If that's all used up, the channel is ignored.
+      byte entry = add_channel_entry(command.data0);
+      if (entry != NO_CHANNEL_ENTRY) {
+        set_layer_value(LAYER_RAW, entry, scale_brightness(command.data1));
+      } else {
+        PERF_COUNT(dropped_commands);
+      }
+    }
+  }
+  
+  // A Program Change (any channel, any program) means the host has sent
+  // everything in the chain, and it can be run right away.
+  else if (command.command == COMMAND_COMMIT) {
+    command_chain_committed = true;
+  }
+  
+  // Key Pressure starts a chase: the note is the chase, and the pressure is
+  // the speed (0 stops it).  The channel is the fade curve.
+  else if (command.command == COMMAND_CHASE) {
+    set_chase(command.data0, command.data1, get_fade_curve(command.channel));
+  }
+  
+  // Channel Pressure releases an override layer: the channel picks the layer
+  // (fixtures, then raw DMX channels), and the pressure is the fade time.
+  else if (command.command == COMMAND_RELEASE) {
+    byte layer = LAYER_FIRST_OVERRIDE + command.channel;
+    if (layer < LAYER_COUNT) {
+      release_layer(layer);
+      compose_layers();
+      set_fade(get_fade_millis(command.data0), FADE_CURVE_LINEAR);
+    } else {
+      PERF_COUNT(dropped_commands);
+    }
+  }
 }
 
 /**
- * The main command loop simply looks for a command, executes it, and calls the
- * fader (which will run as fast as possible) to set the actual light values.
+ * The main command loop runs the fader once for every DMX frame that goes out,
+ * and spends the time in between frames looking for commands and executing
+ * them.  There's no point in calculating fade values more often than they can
+ * be sent, and this keeps the fade steps evenly spaced no matter how much MIDI
+ * traffic is coming in.
  * 
  * The DMX signal is emitted by the DmxMaster library using interrupts and
  * timers and is independent from this code (but does take a good chunk of the
- * CPU time).
+ * CPU time - the UART output, DMX_OUTPUT_UART, takes very little).
  * 
  * The code supports a basic concept of "command chaining" - if a command has
- * been sent, it will wait a few milliseconds for another command before
- * executing the fader.  Proclaim will send commands at roughly one per
- * millisecond (or a bit faster), so waiting for a few ms lets the multiple
- * command sequences all get applied before the fader begins running.
+ * been sent, it will wait a little while for another command before executing
+ * the fader, even if a frame is due.  Proclaim will send commands at roughly
+ * one per millisecond (or a bit faster), so waiting for a bit longer than the
+ * usual gap between commands lets the multiple command sequences all get
+ * applied before the fader begins running.  If the host sends a commit
+ * (Program Change) at the end of the chain, there's no need to wait at all.
  * 
- * Scene mode and fixture mode call the proper function for the update, but the
- * raw DMX channel mode simply sets the values.
+ * When a chain ends, the fader runs straight away rather than waiting for the
+ * next frame, and the frames carry on from there.
  */
 void loop() {
   midi_command command;
-  uint32_t start = millis();
+  bool chain_open = false;
+#ifdef PERF_COUNTERS
+  uint32_t chain_start_micros = 0, stage_start_micros;
+  
+  perf.loop_count++;
+#endif
 
-  // Turn off the blinding red LEDs on the Pro Micro platform.
 #ifdef USE_USB_MIDI
-  TXLED1;
-  RXLED1;
+  turn_off_leds();
 #endif
   
-  // Read and process any updates.  Wait for the timeout to let commands chain.
-  while ((millis() - start) < COMMAND_CHAIN_DELAY_MS) {
-    command = get_midi_command();
-    if (command.command) {
-      // Reset the timeout if this is a valid command.
-      start = millis();
-      
-      // Data 0 (Note) is the scene ID, Data 1 (Velocity) is the fade time.
-      if (command.command == COMMAND_SCENE) {
-        set_scene_with_fade_time(command.data0, command.data1);
-        #ifdef PRINT_STATE
-        Serial.print(F("Setting scene: "));
-        Serial.println(command.data0);
-        #endif
-      } 
-      
-      // Channel is the fixture #, data0 (note) is color or brightness, and
-      // data1 (velocity) is the fade time.  The last fade time sent is the one
-      // that will drive the fade.
-      else if (command.command == COMMAND_FIXTURE) {
-        set_fixture_with_fade_time(command.channel, command.data0,
-                command.data1);
-      } 
-      
-      // DMX channel mode takes "Number" as the channel and "Value" as the
-      // brightness for that channel (scaled).  To actually set the new values
-      // into motion, send a message with "Number" set to 0 and "Value" set to
-      // the desired fade time.
-      else if (command.command == COMMAND_CHANNEL) {
-        if (command.data0 == 0) {
-          set_fade(command.data1);
-        } else {
-          fade_target_values[command.data0] = scale_brightness(command.data1);
-        }
+  // Read and process any updates until the next frame is due, or the command
+  // chain is over.
+  while (true) {
+    if (chain_open) {
+      if (command_chain_committed || (micros() - last_command_micros) >=
+              command_chain_window_micros()) {
+        restart_frame_timing();
+        break;
+      }
+    } else if (dmx_frame_due()) {
+      break;
+    }
+    
+#ifdef PERF_COUNTERS
+    perf_record_poll();
+#endif
+#ifdef SYNC_MASTER
+    run_sync_master();
+#endif
+    if (receive_midi_commands()) {
+      // Reset the timeout if any valid commands came in.
+      record_command_gap(micros());
+#ifdef PERF_COUNTERS
+      if (!chain_open) {
+        chain_start_micros = last_command_micros;
+        perf.chain_count++;
       }
+#endif
+      chain_open = true;
+    }
+    
+    while (pop_midi_command(&command)) {
+#ifdef PERF_COUNTERS
+      stage_start_micros = micros();
+      process_midi_command(command);
+      perf_record_stage(PERF_STAGE_COMMANDS, stage_start_micros);
+#else
+      process_midi_command(command);
+#endif
     }
+#ifdef MIDI_CAPTURE
+    midi_capture_running = MIDI_CAPTURE_NONE;
+#endif
   }
+  command_chain_committed = false;
+#ifdef PERF_COUNTERS
+  if (chain_open) {
+    perf_record_stage(PERF_STAGE_CHAIN, chain_start_micros);
+  }
+#endif
 
-  // Run the fader to update values as needed.
+  // Move any running chase on, start the fades staged by the commands, run the
+  // fader to update values as needed, and write out a little bit of the
+  // finished fades.
+  run_chase();
+  start_staged_fades();
+#ifdef PERF_COUNTERS
+  stage_start_micros = micros();
   run_fader();
+  perf_record_stage(PERF_STAGE_FADER, stage_start_micros);
+  if (chain_open) {
+    perf_record_latency(micros() - chain_start_micros);
+  }
+  
+  stage_start_micros = micros();
+  store_current_to_eeprom();
+  perf_record_stage(PERF_STAGE_EEPROM, stage_start_micros);
+#else
+  run_fader();
+  store_current_to_eeprom();
+#endif
+#ifdef USE_SYSEX
+  run_sysex_reply();
+#endif
+#ifdef TELEMETRY
+  run_telemetry();
+#endif
+  
+  schedule_next_frame();
 
   // Print state every ~8s if needed.
 #ifdef PRINT_STATE